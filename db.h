@@ -1,8 +1,12 @@
 #ifndef SQL_DB_CONN_H
 #define SQL_DB_CONN_H
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <exception>
+#include <memory_resource>
+#include <vector>
 
 namespace sql
 {
@@ -10,6 +14,7 @@ enum class DataType;
 class IDBConnection;
 class IStatement;
 class ISelection;
+class ColumnBatch;
 class Exception;
 }
 
@@ -34,22 +39,105 @@ enum class DataType
 class IDBConnection
 {
 public:
-    virtual IStatement* createStatement() = 0;
+    // What a statement allocates while it runs comes from `memory`, which
+    // must outlive the statement's selections: the parsed query, and the
+    // selections with their snapshots and row ids. Only a join plans and
+    // finds its pairs on the heap, and frees that before select() returns.
+    virtual IStatement* createStatement(
+        std::pmr::memory_resource* memory = std::pmr::get_default_resource()) = 0;
     virtual void close() = 0;
     virtual ~IDBConnection() {}
 };
 
 
+// A statement runs one query at a time and may be reused for the next.
+// It owns the selection it returns, which stays valid until its next 
+// query or close().
 class IStatement
 {
 public:
-    virtual void modify(const std::string& query) = 0;
-    virtual ISelection* select(const std::string& query) = 0;
+    virtual void modify(std::string_view query) = 0;
+    virtual ISelection* select(std::string_view query) = 0;
     virtual void close() = 0;
     virtual ~IStatement() {}
 };
 
 
+// Rows of a selection laid out by column, filled by ISelection::nextBatch.
+// Text values are views of strings the selection holds, valid until it 
+// is closed. The arrays come from `memory` and are kept from one batch 
+// to the next.
+class ColumnBatch
+{
+    struct Column
+    {
+        std::pmr::vector<std::int64_t>      longs;
+        std::pmr::vector<std::string_view>  strings;
+        std::pmr::vector<std::uint64_t>     nulls;     // a bit per row
+
+        explicit Column(std::pmr::memory_resource* memory)
+            : longs(memory), strings(memory), nulls(memory) {}
+    };
+
+    std::pmr::vector<Column>  m_columns;
+    std::size_t               m_size;
+    std::size_t               m_capacity;
+
+public:
+    static const std::size_t DEFAULT_CAPACITY = 1024;
+
+    explicit ColumnBatch(std::size_t capacity = DEFAULT_CAPACITY,
+                         std::pmr::memory_resource* memory = 
+                            std::pmr::get_default_resource())
+        : m_columns(memory), m_size(0), m_capacity(capacity ? capacity : 1) {}
+
+    // At most this many rows come in one batch.
+    std::size_t capacity() const { return m_capacity; }
+
+    std::size_t size() const        { return m_size; }
+    std::size_t columnCount() const { return m_columns.size(); }
+
+    bool isNull(std::size_t column, std::size_t row) const {
+        return (m_columns[column].nulls[row / 64] >> (row % 64)) & 1;
+    }
+    std::int64_t getLong(std::size_t column, std::size_t row) const {
+        return m_columns[column].longs[row];
+    }
+    std::string_view getString(std::size_t column, std::size_t row) const {
+        return m_columns[column].strings[row];
+    }
+
+    // For selections: `rows` rows of `columns` columns, none of them NULL
+    // until set so.
+    void reset(std::size_t columns, std::size_t rows)
+    {
+        if (m_columns.size() > columns) {
+            m_columns.erase(m_columns.begin() + columns, m_columns.end());
+        }
+        while (m_columns.size() < columns) {
+            m_columns.emplace_back(m_columns.get_allocator().resource());
+        }
+        for (Column& column : m_columns) 
+        {
+            column.longs.resize(rows);
+            column.strings.resize(rows);
+            column.nulls.assign((rows + 63) / 64, 0);
+        }
+        m_size = rows;
+    }
+
+    void setNull(std::size_t column, std::size_t row) {
+        m_columns[column].nulls[row / 64] |= std::uint64_t(1) << (row % 64);
+    }
+    void setLong(std::size_t column, std::size_t row, std::int64_t value) {
+        m_columns[column].longs[row] = value;
+    }
+    void setString(std::size_t column, std::size_t row, std::string_view value) {
+        m_columns[column].strings[row] = value;
+    }
+};
+
+
 class ISelection
 {
 public:
@@ -60,6 +148,10 @@ public:
     virtual long getLong(std::size_t columIndex) = 0;
     virtual std::string getString(std::size_t columnIndex) = 0;
 
+    // Fills the batch with the rows from the current one on, as many as
+    // it has room for, and moves past them. Returns how many; 0 at the end.
+    virtual std::size_t nextBatch(ColumnBatch& batch) = 0;
+
     virtual void close() = 0;
     virtual ~ISelection() {}
 };
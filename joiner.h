@@ -1,3 +1,8 @@
+#include <charconv>
+#include <memory>
+#include <memory_resource>
+#include <string_view>
+
 #include "protocol.h"
 #include "db.h"
 #include "util/util.h"
@@ -5,196 +10,448 @@
 class Joiner : public proto::IHandler
 {
     sql::IDBConnection *m_conn;
+
+    // Where LOAD finds its files; empty when clients may not load any.
+    std::string m_loadDir;
+
+    // A connection keeps one statement, made in the connection's memory,
+    // for all of its requests.
+    struct State : proto::IConnectionState
+    {
+        std::unique_ptr<sql::IStatement> statement;
+    };
+
+    // Lends the connection's statement to a request, or makes one for it
+    // alone, and closes it when the request is done: before the memory
+    // its selection came from is released.
+    class Lease
+    {
+        std::unique_ptr<sql::IStatement> m_own;
+        sql::IStatement                 *m_statement;
+
+    public:
+        Lease(sql::IDBConnection* conn, const proto::Request& req)
+        {
+            if (req.state) {
+                m_statement = static_cast<State*>(req.state)->statement.get();
+            }
+            else 
+            {
+                m_own.reset(conn->createStatement(req.memory));
+                m_statement = m_own.get();
+            }
+        }
+
+        ~Lease() { m_statement->close(); }
+
+        Lease(const Lease&) = delete;
+        Lease& operator= (const Lease&) = delete;
+
+        sql::IStatement& operator*() const { return *m_statement; }
+    };
+
 public:
-    Joiner(sql::IDBConnection* db) : m_conn(db) 
+    Joiner(sql::IDBConnection* db, const std::string& loadDir = "") 
+        : m_conn(db), m_loadDir(loadDir) 
     {
-        sql::IStatement *statement = m_conn->createStatement();
-        statement->modify("CREATE TABLE A (id INTEGER PRIMARY KEY, name TEXT);");
-        statement->modify("CREATE TABLE B (id INTEGER PRIMARY KEY, name TEXT);");
+        std::unique_ptr<sql::IStatement> statement(m_conn->createStatement());
+        statement->modify("CREATE TABLE IF NOT EXISTS A (id INTEGER PRIMARY KEY, name TEXT);");
+        statement->modify("CREATE TABLE IF NOT EXISTS B (id INTEGER PRIMARY KEY, name TEXT);");
     }
 
     ~Joiner() = default;
 
+    std::unique_ptr<proto::IConnectionState> open(
+                                std::pmr::memory_resource* memory) override
+    {
+        auto state = std::make_unique<State>();
+        state->statement.reset(m_conn->createStatement(memory));
+        return state;
+    }
+
+    // Everything the request needs, from its words to the rows of the 
+    // selections, is taken from the request's memory.
     void handle(proto::IResponseWriter* rw, proto::Request& req) override
     {
         // Remove '\n'.
-        std::string query = req.query.substr(0, req.query.size() - 1);
-        std::string operation;
+        std::string_view query = req.query.substr(0, req.query.size() - 1);
+        std::string_view operation = query.substr(0, query.find(' '));
+        std::pmr::memory_resource *memory = req.memory;
 
-        auto pos = query.find(' ');
-        if (pos != std::string::npos) {
-            operation = query.substr(0, pos);
-        } else {
-            operation = query;
-        }
+        Lease lease(m_conn, req);
+        sql::IStatement& statement = *lease;
 
         if (operation == proto::SHOW) {
-            show(rw, query);
+            show(rw, statement, query, memory);
         }
         else if (operation == proto::INSERT) {
-            insert(rw, query);
+            insert(rw, statement, query, memory);
         }
         else if (operation == proto::TRUNCATE) {
-            truncate(rw, query);
+            truncate(rw, statement, query, memory);
+        }
+        else if (operation == proto::DELETE) {
+            remove(rw, statement, query, memory);
+        }
+        else if (query == proto::SNAPSHOT) {
+            snapshot(rw, statement);
+        }
+        else if (operation == proto::LOAD) {
+            load(rw, statement, query, memory);
+        }
+        else if (query == proto::MEMORY) {
+            this->memory(rw, statement, memory);
+        }
+        else if (operation == proto::EXPLAIN) {
+            explain(rw, statement, query, memory);
         }
         else if (query == proto::INTERSECTION) {
-            intersection(rw);        
+            intersection(rw, statement, memory);        
         }
         else if (query == proto::SYMDIFF) {
-            symdiff(rw);
+            symdiff(rw, statement, memory);
         } 
         else {
-            rw->writeError("unknown operation '" + operation + "'");
+            rw->writeError("unknown operation '" + std::string(operation) + "'");
         }
     }
 
 private:
-    void show(proto::IResponseWriter* rw, const std::string& query) 
+    using Tokens = std::pmr::vector<std::string_view>;
+
+    // The words of the query between single spaces, as util split() cuts them;
+    // they point into the query.
+    static Tokens words(std::string_view query, 
+                        std::pmr::memory_resource* memory)
+    {
+        Tokens tokens(memory);
+        std::size_t start = 0;
+        for (auto stop = query.find(' '); stop != std::string_view::npos; 
+             stop = query.find(' ', start)) 
+        {
+            tokens.push_back(query.substr(start, stop - start));
+            start = stop + 1;
+        }
+        tokens.push_back(query.substr(start));
+        return tokens;
+    }
+
+    // SQL text put together in the request's memory.
+    template<typename... Parts>
+    static std::pmr::string concat(std::pmr::memory_resource* memory, 
+                                   const Parts&... parts)
+    {
+        std::pmr::string text(memory);
+        (text.append(parts), ...);
+        return text;
+    }
+
+    void show(proto::IResponseWriter* rw, sql::IStatement& statement,
+              std::string_view query, std::pmr::memory_resource* memory) 
     {
-        auto tokens = split(query, ' ');
+        auto tokens = words(query, memory);
         if (tokens.size() != 2) {
             rw->writeError("bad request");
             return;
         }
        
-        std::string sqlQuery = fmt::sprintf("SELECT * FROM %v;", tokens[1]);
-
         try 
         {
-            sql::IStatement *statement = m_conn->createStatement();
-            sql::ISelection *selection = statement->select(sqlQuery);
+            sql::ISelection *selection = statement.select(
+                                            showQuery(tokens[1], memory));
 
-            while(true) 
-            {
-                if (selection->end()) break;
-
-                rw->write(fmt::sprintf("%v,%v\n", 
-                    
-                    selection->isNull(0) ? "" 
-                        : fmt::sprintf("%v", selection->getLong(0)),
-
-                    selection->isNull(1) ? "" 
-                        : fmt::sprintf("%v", selection->getString(1))
-                ));
-                
-                selection->next();
-            }
+            writeRows(rw, selection, memory, [](const sql::ColumnBatch& batch, 
+                                        std::size_t row, std::pmr::string& out) {
+                appendLong(out, batch, 0, row);
+                out += ',';
+                appendString(out, batch, 1, row);
+            });
 
             selection->close();
-            statement->close();
         }
         catch (std::exception& e) {
             rw->writeError(e.what());
         }
     }
 
-    void insert(proto::IResponseWriter* rw, const std::string& query)
+    void insert(proto::IResponseWriter* rw, sql::IStatement& statement,
+                std::string_view query, std::pmr::memory_resource* memory)
     {
-        auto tokens = split(query, ' ');
+        auto tokens = words(query, memory);
         if (tokens.size() != 4) {
             rw->writeError("bad request");
             return;
         }
         
-        std::string sqlQuery = fmt::sprintf("INSERT INTO %v VALUES (%v, \"%v\");",
-                                            tokens[1], tokens[2], tokens[3]);
+        auto sqlQuery = concat(memory, "INSERT INTO ", tokens[1], " VALUES (",
+                               tokens[2], ", \"", tokens[3], "\");");
         
-        sql::IStatement *statement = m_conn->createStatement();
         try {
-            statement->modify(sqlQuery);
+            statement.modify(sqlQuery);
         }
         catch(sql::Exception& e) {
             rw->writeError(e.what());
         }
-        statement->close();
     }
 
-    void truncate(proto::IResponseWriter* rw, const std::string& query)
+    void truncate(proto::IResponseWriter* rw, sql::IStatement& statement,
+                  std::string_view query, std::pmr::memory_resource* memory)
     {
-        auto tokens = split(query, ' ');
+        auto tokens = words(query, memory);
         if (tokens.size() != 2) {
             rw->writeError("bad request");
             return;
         }
 
-        std::string sqlQuery = fmt::sprintf("DELETE FROM %v;", tokens[1]);
+        auto sqlQuery = concat(memory, "DELETE FROM ", tokens[1], ";");
         
-        sql::IStatement *statement = m_conn->createStatement();
         try {
-            statement->modify(sqlQuery);
+            statement.modify(sqlQuery);
         }
         catch(sql::Exception& e) {
             rw->writeError(e.what());
         }
-        statement->close();
     }
 
-    void intersection(proto::IResponseWriter* rw) 
+    void remove(proto::IResponseWriter* rw, sql::IStatement& statement,
+                std::string_view query, std::pmr::memory_resource* memory)
     {
-        std::string query = "SELECT * FROM A JOIN B ON A.id = B.id;";
-        try 
+        auto tokens = words(query, memory);
+        if (tokens.size() != 3) {
+            rw->writeError("bad request");
+            return;
+        }
+
+        auto sqlQuery = concat(memory, "DELETE FROM ", tokens[1], 
+                               " WHERE id = ", tokens[2], ";");
+        
+        try {
+            statement.modify(sqlQuery);
+        }
+        catch(sql::Exception& e) {
+            rw->writeError(e.what());
+        }
+    }
+
+    void snapshot(proto::IResponseWriter* rw, sql::IStatement& statement)
+    {
+        try {
+            statement.modify("SNAPSHOT;");
+        }
+        catch(sql::Exception& e) {
+            rw->writeError(e.what());
+        }
+    }
+
+    // LOAD <table> <file>: the file is named within the load directory,
+    // so a client cannot make the server read anything else.
+    void load(proto::IResponseWriter* rw, sql::IStatement& statement,
+              std::string_view query, std::pmr::memory_resource* memory)
+    {
+        auto tokens = words(query, memory);
+        if (tokens.size() != 3) {
+            rw->writeError("bad request");
+            return;
+        }
+        if (m_loadDir.empty()) {
+            rw->writeError("LOAD is disabled: start the server with --load-dir");
+            return;
+        }
+        std::string_view file = tokens[2];
+        if (file.empty() || file == "." || file == ".." || 
+            file.find('/') != std::string_view::npos) 
         {
-            sql::IStatement *statement = m_conn->createStatement();
-            sql::ISelection *selection = statement->select(query);
+            rw->writeError("bad file name: give one within the load directory");
+            return;
+        }
 
-            while(true) 
-            {
-                if (selection->end()) break;
+        auto sqlQuery = concat(memory, "LOAD ", tokens[1], " ", m_loadDir, "/", 
+                               file, ";");
 
-                rw->write(fmt::sprintf("%v,%v,%v\n", 
-                    
-                    selection->isNull(0) ? "" 
-                        : fmt::sprintf("%v", selection->getLong(0)),
+        try {
+            statement.modify(sqlQuery);
+        }
+        catch(sql::Exception& e) {
+            rw->writeError(e.what());
+        }
+    }
 
-                    selection->isNull(1) ? "" 
-                        : fmt::sprintf("%v", selection->getString(1)),
+    // One "name,bytes" line per figure.
+    void memory(proto::IResponseWriter* rw, sql::IStatement& statement,
+                std::pmr::memory_resource* memory)
+    {
+        try 
+        {
+            sql::ISelection *selection = statement.select("MEMORY;");
 
-                    selection->isNull(3) ? ""
-                        : fmt::sprintf("%v", selection->getString(3))
-                ));
-                
-                selection->next();
-            }
+            writeRows(rw, selection, memory, [](const sql::ColumnBatch& batch, 
+                                        std::size_t row, std::pmr::string& out) {
+                appendString(out, batch, 0, row);
+                out += ',';
+                appendLong(out, batch, 1, row);
+            });
 
             selection->close();
-            statement->close();
         }
         catch (std::exception& e) {
             rw->writeError(e.what());
         }
     }
 
-    void symdiff(proto::IResponseWriter* rw) 
+    // EXPLAIN [ANALYZE] <request>: how the query behind a SHOW,
+    // INTERSECTION or SYMMETRIC_DIFFERENCE request runs, one 
+    // "stage,detail,rows,time_us" line per stage.
+    void explain(proto::IResponseWriter* rw, sql::IStatement& statement,
+                 std::string_view query, std::pmr::memory_resource* memory)
     {
-        std::string query = std::string("SELECT * FROM A FULL OUTER JOIN B") + 
-                            std::string(" ON A.id = B.id WHERE") + 
-                            std::string(" A.id IS NULL OR B.id IS NULL;");
+        auto tokens = words(query, memory);
+        std::string_view prefix = "EXPLAIN ";
+        std::size_t next = 1;
+        if (tokens.size() > next && tokens[next] == "ANALYZE") 
+        {
+            prefix = "EXPLAIN ANALYZE ";
+            ++next;
+        }
+
+        std::pmr::string sqlQuery(memory);
+        if (tokens.size() == next + 1 && tokens[next] == proto::INTERSECTION) {
+            sqlQuery = intersectionQuery();
+        }
+        else if (tokens.size() == next + 1 && tokens[next] == proto::SYMDIFF) {
+            sqlQuery = symdiffQuery();
+        }
+        else if (tokens.size() == next + 2 && tokens[next] == proto::SHOW) {
+            sqlQuery = showQuery(tokens[next + 1], memory);
+        }
+        else {
+            rw->writeError("bad request");
+            return;
+        }
+
         try 
         {
-            sql::IStatement *statement = m_conn->createStatement();
-            sql::ISelection *selection = statement->select(query);
+            sql::ISelection *selection = statement.select(
+                                            concat(memory, prefix, sqlQuery));
+
+            writeRows(rw, selection, memory, [](const sql::ColumnBatch& batch, 
+                                        std::size_t row, std::pmr::string& out) {
+                appendString(out, batch, 0, row);
+                out += ',';
+                appendString(out, batch, 1, row);
+                out += ',';
+                appendLong(out, batch, 2, row);
+                out += ',';
+                appendLong(out, batch, 3, row);
+            });
+
+            selection->close();
+        }
+        catch (std::exception& e) {
+            rw->writeError(e.what());
+        }
+    }
 
-            while(true) 
+    // Writes the selection a batch at a time; `line` appends a row of the
+    // batch to the output, without the newline.
+    template<typename Line>
+    static void writeRows(proto::IResponseWriter* rw, 
+                          sql::ISelection* selection, 
+                          std::pmr::memory_resource* memory, Line line)
+    {
+        sql::ColumnBatch batch(sql::ColumnBatch::DEFAULT_CAPACITY, memory);
+        std::pmr::string out(memory);
+        while (selection->nextBatch(batch) != 0) 
+        {
+            out.clear();
+            for (std::size_t row = 0; row < batch.size(); ++row) 
             {
-                if (selection->end()) break;
+                line(batch, row, out);
+                out += '\n';
+            }
+            rw->write(out);
+        }
+    }
 
-                rw->write(fmt::sprintf("%v,%v,%v\n", 
-                    
-                    selection->isNull(0) ? fmt::sprintf("%v", selection->getLong(2)) 
-                        : fmt::sprintf("%v", selection->getLong(0)),
+    // A value, or nothing for a NULL.
+    static void appendLong(std::pmr::string& out, const sql::ColumnBatch& batch,
+                           std::size_t column, std::size_t row)
+    {
+        if (batch.isNull(column, row)) {
+            return;
+        }
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), 
+                                    batch.getLong(column, row));
+        out.append(digits, result.ptr);
+    }
 
-                    selection->isNull(1) ? "" 
-                        : fmt::sprintf("%v", selection->getString(1)),
+    static void appendString(std::pmr::string& out, 
+                             const sql::ColumnBatch& batch,
+                             std::size_t column, std::size_t row)
+    {
+        if (!batch.isNull(column, row)) {
+            out.append(batch.getString(column, row));
+        }
+    }
 
-                    selection->isNull(3) ? ""
-                        : fmt::sprintf("%v", selection->getString(3))
-                ));
-                
-                selection->next();
-            }
+    static std::pmr::string showQuery(std::string_view table,
+                                      std::pmr::memory_resource* memory) {
+        return concat(memory, "SELECT id, name FROM ", table, ";");
+    }
+
+    static std::string_view intersectionQuery() {
+        return "SELECT A.id, A.name, B.name FROM A JOIN B ON A.id = B.id;";
+    }
+
+    static std::string_view symdiffQuery()
+    {
+        return "SELECT A.id, B.id, A.name, B.name"
+               " FROM A FULL OUTER JOIN B"
+               " ON A.id = B.id WHERE"
+               " A.id IS NULL OR B.id IS NULL;";
+    }
+
+    void intersection(proto::IResponseWriter* rw, sql::IStatement& statement,
+                      std::pmr::memory_resource* memory) 
+    {
+        try 
+        {
+            sql::ISelection *selection = statement.select(intersectionQuery());
+
+            writeRows(rw, selection, memory, [](const sql::ColumnBatch& batch, 
+                                        std::size_t row, std::pmr::string& out) {
+                appendLong(out, batch, 0, row);
+                out += ',';
+                appendString(out, batch, 1, row);
+                out += ',';
+                appendString(out, batch, 2, row);
+            });
+
+            selection->close();
+        }
+        catch (std::exception& e) {
+            rw->writeError(e.what());
+        }
+    }
+
+    void symdiff(proto::IResponseWriter* rw, sql::IStatement& statement,
+                 std::pmr::memory_resource* memory) 
+    {
+        try 
+        {
+            sql::ISelection *selection = statement.select(symdiffQuery());
+
+            // The id of whichever side has the row.
+            writeRows(rw, selection, memory, [](const sql::ColumnBatch& batch, 
+                                        std::size_t row, std::pmr::string& out) {
+                appendLong(out, batch, batch.isNull(0, row) ? 1 : 0, row);
+                out += ',';
+                appendString(out, batch, 2, row);
+                out += ',';
+                appendString(out, batch, 3, row);
+            });
 
             selection->close();
-            statement->close();
         }
         catch (std::exception& e) {
             rw->writeError(e.what());
@@ -1,31 +1,159 @@
 #include <iostream>
 #include <memory>
+#include <stdexcept>
+#include <vector>
 
 #include "protocol.h"
 #include "joiner.h"
 #include "memstore/memstore.h"
 
 
+void usage()
+{
+    std::cout << "usage: join_server <port> [--join-threads N] [--shards N]\n"
+                 "                   [--wal PATH] [--durability sync|batch|interval]\n"
+                 "                   [--wal-interval MS]\n"
+                 "                   [--snapshot PATH] [--snapshot-interval SEC]\n"
+                 "                   [--load TABLE=PATH]... [--load-dir DIR]\n"
+                 "                   [--memory-limit BYTES]" 
+              << std::endl;
+}
+
+
+// Fills the table from the file unless it already has rows: with --wal 
+// or --snapshot those came back from the previous run, which made the 
+// same load, so a restart with the same command line does not repeat it.
+void loadAtStart(sql::IDBConnection* db, const std::string& table, 
+                 const std::string& path)
+{
+    std::unique_ptr<sql::IStatement> statement(db->createStatement());
+    try 
+    {
+        if (!statement->select(fmt::sprintf("SELECT * FROM %v;", table))->end()) 
+        {
+            std::cout << "table " << table << " already has rows, " 
+                      << path << " not loaded" << std::endl;
+            return;
+        }
+        statement->close();
+        statement->modify(fmt::sprintf("LOAD %v %v;", table, path));
+    }
+    catch (std::exception& e) {
+        throw std::runtime_error(fmt::sprintf("cannot load %v into %v: %v", 
+                                              path, table, e.what()));
+    }
+}
+
+
 int main(int argc, char* argv[]) 
 {
-    if (argc != 2) {
+    if (argc < 2) {
         std::cout << "too few arguments" << std::endl;
+        usage();
+        return 1;
+    }
+
+    mem::Options options;
+    std::vector<std::pair<std::string, std::string>> loads;
+    std::string loadDir;
+
+    try {
+        for (int i = 2; i < argc; ++i) 
+        {
+            std::string arg = argv[i];
+            if (arg == "--join-threads" && i + 1 < argc) {
+                options.joinThreads = std::stoul(argv[++i]);
+            }
+            else if (arg == "--shards" && i + 1 < argc) {
+                options.tableShards = std::stoul(argv[++i]);
+            }
+            else if (arg == "--wal" && i + 1 < argc) {
+                options.walPath = argv[++i];
+            }
+            else if (arg == "--durability" && i + 1 < argc) 
+            {
+                std::string mode = argv[++i];
+                if (mode == "sync") {
+                    options.durability = mem::Durability::SYNC;
+                }
+                else if (mode == "batch") {
+                    options.durability = mem::Durability::BATCH;
+                }
+                else if (mode == "interval") {
+                    options.durability = mem::Durability::INTERVAL;
+                }
+                else {
+                    std::cout << "unknown durability " << mode << std::endl;
+                    usage();
+                    return 1;
+                }
+            }
+            else if (arg == "--wal-interval" && i + 1 < argc) {
+                options.walIntervalMs = std::stoul(argv[++i]);
+            }
+            else if (arg == "--snapshot" && i + 1 < argc) {
+                options.snapshotPath = argv[++i];
+            }
+            else if (arg == "--snapshot-interval" && i + 1 < argc) {
+                options.snapshotIntervalSec = std::stoul(argv[++i]);
+            }
+            else if (arg == "--memory-limit" && i + 1 < argc) {
+                options.memoryLimit = std::stoull(argv[++i]);
+            }
+            else if (arg == "--load" && i + 1 < argc) 
+            {
+                std::string load = argv[++i];
+                auto pos = load.find('=');
+                if (pos == std::string::npos || pos == 0) {
+                    std::cout << "bad load " << load << std::endl;
+                    usage();
+                    return 1;
+                }
+                loads.emplace_back(load.substr(0, pos), load.substr(pos + 1));
+            }
+            else if (arg == "--load-dir" && i + 1 < argc) {
+                loadDir = argv[++i];
+            }
+            else {
+                std::cout << "unknown argument " << arg << std::endl;
+                usage();
+                return 1;
+            }
+        }
+    }
+    catch(std::exception& e) {
+        std::cout << "bad argument: " << e.what() << std::endl;
         return 1;
     }
 
-    sql::IDBConnection *db = mem::open();
+    sql::IDBConnection *db;
+    try {
+        db = mem::open(options);
+    }
+    catch(std::exception& e) {
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
 
+    int status = 0;
     try {
         int port = std::stoi(argv[1]);
-        proto::Server server(port, new Joiner(db));
+        std::unique_ptr<Joiner> joiner(new Joiner(db, loadDir));
+
+        for (const auto& load : loads) {
+            loadAtStart(db, load.first, load.second);
+        }
+
+        proto::Server server(port, joiner.release());
         server.run();
     }
     catch(std::exception& e) {
-        std::cout << e.what();
+        std::cout << e.what() << std::endl;
+        status = 1;
     }
 
     db->close();
     delete db;
 
-    return 0;
+    return status;
 }
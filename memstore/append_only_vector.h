@@ -0,0 +1,107 @@
+#ifndef APPEND_ONLY_VECTOR_H
+#define APPEND_ONLY_VECTOR_H
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+// A vector that only grows, with one writer and any number of concurrent
+// readers. Elements never move: storage is a list of segments, each twice
+// as large as the previous one. The size is published after the element
+// is constructed, so readers may use every index below size() without
+// locking.
+template<typename T>
+class AppendOnlyVector
+{
+    static const std::size_t FIRST_SEGMENT_BITS = 10;
+    static const std::size_t SEGMENTS = 48;
+
+    T*                       m_segments[SEGMENTS] = {};
+    std::atomic<std::size_t> m_size{0};
+
+public:
+    AppendOnlyVector() = default;
+    ~AppendOnlyVector();
+
+    AppendOnlyVector(const AppendOnlyVector&) = delete;
+    AppendOnlyVector& operator= (const AppendOnlyVector&) = delete;
+
+    std::size_t size() const noexcept {
+        return m_size.load(std::memory_order_acquire);
+    }
+
+    bool empty() const noexcept { return size() == 0; }
+
+    // Elements the allocated segments have room for.
+    std::size_t capacity() const noexcept
+    {
+        std::size_t n = size();
+        if (n == 0) {
+            return 0;
+        }
+        std::size_t q = ((n - 1) >> FIRST_SEGMENT_BITS) + 1;
+        std::size_t last = 63 - __builtin_clzll(q);
+        return ((std::size_t(1) << (last + 1)) - 1) << FIRST_SEGMENT_BITS;
+    }
+
+    // Elements the next push_back() allocates a segment for, 0 if it 
+    // still fits.
+    std::size_t growth() const noexcept
+    {
+        std::size_t room = capacity();
+        return size() < room ? 0 : room + (std::size_t(1) << FIRST_SEGMENT_BITS);
+    }
+
+    const T& operator[] (std::size_t i) const { return *locate(i); }
+    T& operator[] (std::size_t i) { return *locate(i); }
+
+    // Must not be called concurrently with another push_back().
+    void push_back(T&& value);
+
+private:
+    static std::size_t capacity(std::size_t segment) {
+        return std::size_t(1) << (FIRST_SEGMENT_BITS + segment);
+    }
+
+    T* locate(std::size_t i) const
+    {
+        std::size_t q = (i >> FIRST_SEGMENT_BITS) + 1;
+        std::size_t segment = 63 - __builtin_clzll(q);
+        std::size_t first = ((std::size_t(1) << segment) - 1)
+                                << FIRST_SEGMENT_BITS;
+        return m_segments[segment] + (i - first);
+    }
+};
+
+
+template<typename T>
+AppendOnlyVector<T>::~AppendOnlyVector()
+{
+    std::size_t count = m_size.load(std::memory_order_relaxed);
+    for (std::size_t i = 0; i < count; ++i) {
+        locate(i)->~T();
+    }
+    for (T* segment : m_segments) {
+        ::operator delete(segment);
+    }
+}
+
+
+template<typename T>
+void AppendOnlyVector<T>::push_back(T&& value)
+{
+    std::size_t i = m_size.load(std::memory_order_relaxed);
+
+    std::size_t q = (i >> FIRST_SEGMENT_BITS) + 1;
+    std::size_t segment = 63 - __builtin_clzll(q);
+    if (m_segments[segment] == nullptr) {
+        m_segments[segment] = static_cast<T*>(
+                        ::operator new(sizeof(T) * capacity(segment)));
+    }
+
+    new (locate(i)) T(std::move(value));
+    m_size.store(i + 1, std::memory_order_release);
+}
+
+#endif // APPEND_ONLY_VECTOR_H
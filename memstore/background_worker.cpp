@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <iostream>
+
+#include "background_worker.h"
+
+BackgroundWorker::BackgroundWorker() 
+    : m_stop(false), m_thread([this]() { work(); })
+{
+}
+
+
+BackgroundWorker::~BackgroundWorker()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    m_thread.join();
+}
+
+
+void BackgroundWorker::post(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(std::move(job));
+    }
+    m_cond.notify_one();
+}
+
+
+void BackgroundWorker::every(Clock::duration interval, 
+                             std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_periodic.push_back({interval, Clock::now() + interval, 
+                              std::move(task)});
+    }
+    m_cond.notify_one();
+}
+
+
+void BackgroundWorker::work()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        std::function<void()> job;
+
+        if (!m_jobs.empty()) 
+        {
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+        }
+        else if (m_stop) {
+            return;
+        }
+        else 
+        {
+            auto due = std::min_element(m_periodic.begin(), m_periodic.end(),
+                [](const Periodic& a, const Periodic& b) { 
+                    return a.next < b.next; 
+                });
+
+            if (due == m_periodic.end()) {
+                m_cond.wait(lock);
+                continue;
+            }
+            if (Clock::now() < due->next) {
+                m_cond.wait_until(lock, due->next);
+                continue;
+            }
+            due->next = Clock::now() + due->interval;
+            job = due->task;
+        }
+
+        lock.unlock();
+        try {
+            job();
+        }
+        catch (std::exception& e) {
+            std::cerr << "background job failed: " << e.what() << std::endl;
+        }
+        lock.lock();
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef BACKGROUND_WORKER_H
+#define BACKGROUND_WORKER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A single thread for housekeeping that must stay off the query path: 
+// jobs posted once and tasks repeated at a fixed interval. Exceptions 
+// thrown by them are reported and otherwise ignored.
+class BackgroundWorker
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Periodic
+    {
+        Clock::duration       interval;
+        Clock::time_point     next;
+        std::function<void()> task;
+    };
+
+    std::deque<std::function<void()>> m_jobs;
+    std::vector<Periodic>             m_periodic;
+    std::mutex                        m_mutex;
+    std::condition_variable           m_cond;
+    bool                              m_stop;
+    std::thread                       m_thread;
+
+public:
+    BackgroundWorker();
+
+    // Runs the jobs still queued, then stops.
+    ~BackgroundWorker();
+
+    BackgroundWorker(const BackgroundWorker&) = delete;
+    BackgroundWorker& operator= (const BackgroundWorker&) = delete;
+
+    void post(std::function<void()> job);
+    void every(Clock::duration interval, std::function<void()> task);
+
+private:
+    void work();
+};
+
+#endif // BACKGROUND_WORKER_H
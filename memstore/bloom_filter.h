@@ -0,0 +1,88 @@
+#ifndef BLOOM_FILTER_H
+#define BLOOM_FILTER_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Blocked Bloom filter: the hash of a key picks one 32-byte block and
+// sets one bit in each of its eight 32-bit words, so a lookup reads a
+// single cache line. Keys are never missed; with 16 bits per key about
+// 0.1% of absent keys pass. Keys cannot be taken out, a filter is built
+// anew to drop them.
+class BloomFilter
+{
+    using Block = std::array<std::uint32_t, 8>;
+
+    static const std::size_t BITS_PER_KEY = 16;
+    static const std::size_t KEYS_PER_BLOCK = sizeof(Block) * 8 / BITS_PER_KEY;
+
+    std::vector<Block> m_blocks;
+    std::size_t        m_keys = 0;
+
+public:
+    // Room for `capacity` keys at the promised rate; more still work,
+    // with more false positives.
+    explicit BloomFilter(std::size_t capacity = 0)
+        : m_blocks(std::max<std::size_t>(
+                    (capacity + KEYS_PER_BLOCK - 1) / KEYS_PER_BLOCK, 1)) {}
+
+    static std::uint64_t hash(long key)
+    {
+        // splitmix64 finalizer: every input bit reaches every output bit.
+        std::uint64_t h = std::uint64_t(key);
+        h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+        h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+        return h ^ (h >> 31);
+    }
+
+    static std::uint64_t hash(const std::string& key) {
+        return hash(long(std::hash<std::string>()(key)));
+    }
+
+    void insert(std::uint64_t h)
+    {
+        Block& block = m_blocks[blockOf(h)];
+        for (std::size_t i = 0; i < block.size(); ++i) {
+            block[i] |= bit(h, i);
+        }
+        ++m_keys;
+    }
+
+    bool mayContain(std::uint64_t h) const
+    {
+        const Block& block = m_blocks[blockOf(h)];
+        for (std::size_t i = 0; i < block.size(); ++i) {
+            if ((block[i] & bit(h, i)) == 0) return false;
+        }
+        return true;
+    }
+
+    // Keys inserted, and how many the filter was sized for.
+    std::size_t size() const noexcept { return m_keys; }
+    std::size_t capacity() const noexcept {
+        return m_blocks.size() * KEYS_PER_BLOCK;
+    }
+
+    std::size_t bytes() const noexcept { return m_blocks.size() * sizeof(Block); }
+
+private:
+    // The upper half of the hash picks the block, the lower half the bits.
+    std::size_t blockOf(std::uint64_t h) const {
+        return std::size_t(((h >> 32) * m_blocks.size()) >> 32);
+    }
+
+    static std::uint32_t bit(std::uint64_t h, std::size_t word)
+    {
+        static const std::uint32_t SALT[8] = {
+            0x47B6137Bu, 0x44974D91u, 0x8824AD5Bu, 0xA2B7289Du,
+            0x705495C7u, 0x2DF1424Bu, 0x9EFC4947u, 0x5C6BFB31u
+        };
+        return std::uint32_t(1) << ((std::uint32_t(h) * SALT[word]) >> 27);
+    }
+};
+
+#endif // BLOOM_FILTER_H
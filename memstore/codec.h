@@ -0,0 +1,165 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include "table.h"
+
+// Binary encoding shared by the write-ahead log and the snapshot files.
+// Integers are little endian, strings a u32 length and the bytes, values
+// a type tag and the value.
+namespace codec
+{
+inline void putU8(std::string& out, std::uint8_t v) {
+    out.push_back(char(v));
+}
+
+inline void putU32(std::string& out, std::uint32_t v) {
+    for (int i = 0; i < 4; ++i) out.push_back(char(v >> (8 * i)));
+}
+
+inline void putU64(std::string& out, std::uint64_t v) {
+    for (int i = 0; i < 8; ++i) out.push_back(char(v >> (8 * i)));
+}
+
+inline void putString(std::string& out, const std::string& s)
+{
+    putU32(out, s.size());
+    out.append(s);
+}
+
+// One tag byte: the type in the upper bits, whether it is NULL in bit 0.
+inline void putValue(std::string& out, const DataObject& value)
+{
+    putU8(out, std::uint8_t(value.type()) << 1 | value.isNull());
+    if (value.isNull()) {
+        return;
+    }
+    if (value.type() == sql::DataType::INTEGER) {
+        putU64(out, std::uint64_t(value.getLong()));
+    }
+    else {
+        putString(out, value.getString());
+    }
+}
+
+// Per column its name, type and flags: 1 for the primary key, 2 for a
+// dictionary-encoded one.
+inline void putSchema(std::string& out, const Schema& schema)
+{
+    putU32(out, schema.size());
+    for (const ColumnInfo& column : schema)
+    {
+        putString(out, column.name());
+        putU8(out, std::uint8_t(column.type()));
+        putU8(out, std::uint8_t(column.isPrimaryKey() | 
+                                column.isDictionary() << 1));
+    }
+}
+
+
+// For arrays of u64 read in place, e.g. from a mapped file.
+inline std::uint64_t getU64(const char* p)
+{
+    std::uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) v |= std::uint64_t(std::uint8_t(p[i])) << (8 * i);
+    return v;
+}
+
+
+// Decodes from a buffer it does not own; throws on reading past its end.
+class Reader
+{
+    const char* m_pos;
+    const char* m_end;
+
+public:
+    Reader(const char* data, std::size_t size)
+        : m_pos(data), m_end(data + size) {}
+
+    std::size_t left() const { return m_end - m_pos; }
+
+    const char* take(std::size_t size)
+    {
+        if (left() < size) {
+            throw sql::Exception("malformed binary data");
+        }
+        const char* p = m_pos;
+        m_pos += size;
+        return p;
+    }
+
+    std::uint8_t u8() { return std::uint8_t(*take(1)); }
+
+    std::uint32_t u32()
+    {
+        const char* p = take(4);
+        std::uint32_t v = 0;
+        for (int i = 0; i < 4; ++i) v |= std::uint32_t(std::uint8_t(p[i])) << (8 * i);
+        return v;
+    }
+
+    std::uint64_t u64() { return getU64(take(8)); }
+
+    std::string string()
+    {
+        std::uint32_t size = u32();
+        return std::string(take(size), size);
+    }
+
+    DataObject value()
+    {
+        std::uint8_t tag = u8();
+        auto type = sql::DataType(tag >> 1);
+        if (tag & 1) {
+            return DataObject(type);
+        }
+        if (type == sql::DataType::INTEGER) {
+            return DataObject(long(u64()));
+        }
+        return DataObject(string());
+    }
+
+    Schema schema()
+    {
+        Schema schema;
+        for (std::uint32_t n = u32(); n > 0; --n)
+        {
+            std::string name = string();
+            auto type = sql::DataType(u8());
+            std::uint8_t flags = u8();
+            schema.addColumn(ColumnInfo(name, type, flags & 1, flags & 2));
+        }
+        return schema;
+    }
+};
+
+
+inline std::uint32_t crc32(const char* data, std::size_t size)
+{
+    static const auto table = []()
+    {
+        std::array<std::uint32_t, 256> t;
+        for (std::uint32_t i = 0; i < 256; ++i)
+        {
+            std::uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+
+    std::uint32_t crc = 0xFFFFFFFFu;
+    for (std::size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ std::uint8_t(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+} // namespace codec
+
+#endif // CODEC_H
@@ -0,0 +1,76 @@
+#ifndef COMBINER_H
+#define COMBINER_H
+
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <vector>
+
+// Flat combining in front of a contended lock. A thread publishes its
+// operation and, unless another thread is already combining, takes the
+// lock once and applies every operation published so far, its own among
+// them, then wakes their threads. The others wait for their results
+// instead of for the lock. An operation that throws fails alone: the
+// exception is rethrown in the thread that published it.
+template<typename Operation>
+class Combiner
+{
+    struct Node
+    {
+        Operation          *operation;
+        bool                done;
+        std::exception_ptr  error;
+    };
+
+    std::mutex               m_mutex;
+    std::condition_variable  m_done;
+    std::vector<Node*>       m_pending;
+    std::vector<Node*>       m_batch;       // of the combiner; kept for its capacity
+    bool                     m_combining = false;
+
+public:
+    // Returns once `apply` has run on the operation under `lockable`, on
+    // this thread or on another one, so all operations published to the
+    // same combiner must be applied the same way.
+    template<typename Lockable, typename Apply>
+    void run(Operation& operation, Lockable& lockable, Apply apply)
+    {
+        Node node{&operation, false, nullptr};
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_pending.push_back(&node);
+        while (!node.done)
+        {
+            if (m_combining)
+            {
+                m_done.wait(lock);
+                continue;
+            }
+            m_combining = true;
+            m_batch.swap(m_pending);
+            lock.unlock();
+            {
+                std::unique_lock<Lockable> guard(lockable);
+                for (Node* pending : m_batch)
+                {
+                    try {
+                        apply(*pending->operation);
+                    }
+                    catch (...) {
+                        pending->error = std::current_exception();
+                    }
+                }
+            }
+            lock.lock();
+            for (Node* pending : m_batch) pending->done = true;
+            m_batch.clear();
+            m_combining = false;
+            m_done.notify_all();
+        }
+        lock.unlock();
+
+        if (node.error) std::rethrow_exception(node.error);
+    }
+};
+
+#endif // COMBINER_H
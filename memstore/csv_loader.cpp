@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <iterator>
+
+#include "memstore.h"
+#include "mapped_file.h"
+#include "csv_loader.h"
+
+namespace
+{
+// More chunks than threads, so a thread that gets short lines does not 
+// sit idle while another one finishes.
+const std::size_t CHUNKS_PER_THREAD = 4;
+const std::size_t MIN_CHUNK_SIZE = 1 << 16;
+
+
+DataObject toValue(const char* begin, const char* end, bool quoted,
+                   sql::DataType type)
+{
+    if (begin == end && !quoted) {
+        return DataObject(type);
+    }
+    if (type == sql::DataType::TEXT) {
+        return DataObject(std::string(begin, end));
+    }
+
+    long value;
+    auto result = std::from_chars(begin, end, value);
+    if (result.ec != std::errc() || result.ptr != end) {
+        throw sql::Exception("bad integer");
+    }
+    return DataObject(value);
+}
+
+
+Record parseLine(const char* begin, const char* end, const Schema& schema)
+{
+    Record row;
+    row.reserve(schema.size());
+
+    const char* p = begin;
+    for (std::size_t col = 0; col < schema.size(); ++col) 
+    {
+        if (col > 0) 
+        {
+            if (p == end || *p != ',') {
+                throw sql::Exception("too few fields");
+            }
+            ++p;
+        }
+
+        if (p == end || *p != '"') 
+        {
+            const char* field = p;
+            p = std::find(p, end, ',');
+            row.push_back(toValue(field, p, false, schema.typeOf(col)));
+            continue;
+        }
+
+        std::string text;
+        for (++p; ; ++p) 
+        {
+            if (p == end) {
+                throw sql::Exception("unterminated quote");
+            }
+            if (*p == '"') 
+            {
+                if (p + 1 == end || p[1] != '"') break;
+                ++p;
+            }
+            text.push_back(*p);
+        }
+        ++p;
+        row.push_back(toValue(text.data(), text.data() + text.size(), true,
+                              schema.typeOf(col)));
+    }
+
+    if (p != end) {
+        throw sql::Exception("too many fields");
+    }
+    return row;
+}
+
+
+// The end of the line starting at p, without a trailing '\r'.
+const char* lineEnd(const char* p, const char* end)
+{
+    auto newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    const char* last = newline ? newline : end;
+    return last > p && last[-1] == '\r' ? last - 1 : last;
+}
+
+
+// Just past the line that contains p.
+const char* nextLine(const char* p, const char* end)
+{
+    auto newline = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    return newline ? newline + 1 : end;
+}
+
+
+bool isHeader(const char* begin, const char* end, const Schema& schema)
+{
+    std::string header;
+    for (const ColumnInfo& column : schema) {
+        header += (header.empty() ? "" : ",") + column.name();
+    }
+    return std::string(begin, end) == header;
+}
+
+} // namespace
+
+
+std::vector<std::vector<Record>> csv::parse(
+                const std::string& path, const Schema& schema,
+                std::size_t parts,
+                const std::function<std::size_t(const Record&)>& part,
+                ThreadPool& pool)
+{
+    MappedFile file(path);
+    const char* data = file.data();
+    const char* end = data + file.size();
+    const char* begin = data;
+
+    if (data != end && isHeader(data, lineEnd(data, end), schema)) {
+        data = nextLine(data, end);
+    }
+
+    std::size_t size = end - data;
+    std::size_t chunks = std::max<std::size_t>(1, 
+                            std::min(pool.size() * CHUNKS_PER_THREAD, 
+                                     size / MIN_CHUNK_SIZE));
+
+    std::vector<const char*> bounds(chunks + 1, end);
+    bounds[0] = data;
+    for (std::size_t i = 1; i < chunks; ++i) {
+        bounds[i] = nextLine(std::max(bounds[i - 1], data + size * i / chunks), 
+                             end);
+    }
+
+    std::vector<std::vector<std::vector<Record>>> results(
+                        chunks, std::vector<std::vector<Record>>(parts));
+
+    pool.parallelFor(chunks, [&](std::size_t chunk) 
+    {
+        for (const char* line = bounds[chunk]; line < bounds[chunk + 1]; 
+             line = nextLine(line, end)) 
+        {
+            const char* last = lineEnd(line, end);
+            if (line == last) {
+                continue;
+            }
+            try 
+            {
+                Record row = parseLine(line, last, schema);
+                results[chunk][part(row)].push_back(std::move(row));
+            }
+            catch (sql::Exception& e) 
+            {
+                // Only where and why: the file may not be the caller's to read.
+                long number = std::count(begin, line, '\n') + 1;
+                throw sql::Exception(fmt::sprintf("%v: line %v: %v", path, 
+                                                  number, e.what()));
+            }
+        }
+    });
+
+    std::vector<std::vector<Record>> rows(parts);
+    for (std::size_t p = 0; p < parts; ++p) 
+    {
+        std::size_t count = 0;
+        for (const auto& result : results) count += result[p].size();
+        rows[p].reserve(count);
+
+        for (auto& result : results) 
+        {
+            rows[p].insert(rows[p].end(), 
+                           std::make_move_iterator(result[p].begin()),
+                           std::make_move_iterator(result[p].end()));
+            std::vector<Record>().swap(result[p]);
+        }
+    }
+    return rows;
+}
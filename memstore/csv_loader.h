@@ -0,0 +1,30 @@
+#ifndef CSV_LOADER_H
+#define CSV_LOADER_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "table.h"
+#include "thread_pool.h"
+
+// Rows of a CSV file with one row per line and the columns of a schema:
+//
+//   1,first name
+//   2,"quoted, with a comma and a "" quote"
+//
+// An empty field is NULL. A first line naming the columns is skipped.
+namespace csv
+{
+// The file is mapped and cut into chunks on line boundaries, which are
+// parsed in parallel on the pool. Rows come back grouped by part(row), 
+// a number below parts, and in file order within a group. Throws on the
+// first malformed line.
+std::vector<std::vector<Record>> parse(
+                const std::string& path, const Schema& schema, 
+                std::size_t parts, 
+                const std::function<std::size_t(const Record&)>& part,
+                ThreadPool& pool);
+}
+
+#endif // CSV_LOADER_H
@@ -1,3 +1,6 @@
+#ifndef DATA_OBJECT_H
+#define DATA_OBJECT_H
+
 #include "memstore.h"
 
 // DataObject represents a value of a type from [long, std::string].
@@ -43,7 +46,12 @@ public:
     
     long getLong() const                 { return m_value.num; }
     const std::string& getString() const { return m_value.str; }
+
+    // Moves the string out, leaving an empty one behind.
+    std::string releaseString()          { return std::move(m_value.str); }
 };
 
 
-using Record = std::vector<DataObject>;
\ No newline at end of file
+using Record = std::vector<DataObject>;
+
+#endif // DATA_OBJECT_H
@@ -0,0 +1,81 @@
+#ifndef EXPLAIN_H
+#define EXPLAIN_H
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "data_object.h"
+
+// What a query did, for EXPLAIN: one line per stage with the rows it
+// produced and, with ANALYZE, how long it took. A stage met again, as the
+// join of each pair of shards, adds to the same line.
+class Profile
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+private:
+    struct Stage
+    {
+        std::string      name;
+        std::string      detail;
+        long             rows;      // negative when unknown
+        Clock::duration  time;      // negative when not timed
+    };
+
+    bool                m_analyze;
+    std::vector<Stage>  m_stages;
+
+public:
+    // Types of the columns the query returns.
+    std::vector<sql::DataType> types;
+
+    explicit Profile(bool analyze) : m_analyze(analyze) {}
+
+    // Without ANALYZE the query is only planned, not run.
+    bool analyze() const { return m_analyze; }
+
+    // Adds to the stage with that name and detail, or starts it.
+    void add(const std::string& name, const std::string& detail,
+             long rows = -1, Clock::duration time = Clock::duration(-1))
+    {
+        for (Stage& stage : m_stages)
+        {
+            if (stage.name == name && stage.detail == detail)
+            {
+                if (rows >= 0) stage.rows = std::max(stage.rows, 0L) + rows;
+                if (time.count() >= 0) {
+                    stage.time = std::max(stage.time, Clock::duration::zero()) 
+                                 + time;
+                }
+                return;
+            }
+        }
+        m_stages.push_back({name, detail, rows, time});
+    }
+
+    // (stage, detail, rows, microseconds) records; the time is NULL for
+    // stages timed as part of another one, and for all without ANALYZE.
+    std::vector<Record> report() const
+    {
+        std::vector<Record> records;
+        for (const Stage& stage : m_stages)
+        {
+            Record record{DataObject(stage.name), DataObject(stage.detail)};
+            record.push_back(stage.rows >= 0
+                                ? DataObject(stage.rows)
+                                : DataObject(sql::DataType::INTEGER));
+            record.push_back(m_analyze && stage.time.count() >= 0
+                                ? DataObject(long(std::chrono::duration_cast<
+                                        std::chrono::microseconds>(
+                                            stage.time).count()))
+                                : DataObject(sql::DataType::INTEGER));
+            records.push_back(std::move(record));
+        }
+        return records;
+    }
+};
+
+#endif // EXPLAIN_H
@@ -0,0 +1,220 @@
+#include <algorithm>
+
+#include "intersect.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define INTERSECT_X86 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+// Above this length ratio galloping beats a linear merge.
+const std::size_t GALLOP_RATIO = 32;
+
+
+std::size_t mergeTail(const std::int64_t* a, std::size_t na, std::size_t i,
+                      const std::int64_t* b, std::size_t nb, std::size_t j,
+                      std::int64_t* out, std::size_t k)
+{
+    while (i < na && j < nb)
+    {
+        if (a[i] < b[j]) {
+            ++i;
+        }
+        else if (b[j] < a[i]) {
+            ++j;
+        }
+        else {
+            out[k++] = a[i];
+            ++i;
+            ++j;
+        }
+    }
+    return k;
+}
+
+
+std::size_t mergeScalar(const std::int64_t* a, std::size_t na,
+                        const std::int64_t* b, std::size_t nb,
+                        std::int64_t* out)
+{
+    return mergeTail(a, na, 0, b, nb, 0, out, 0);
+}
+
+
+#ifdef INTERSECT_X86
+
+// Compares a block of two values from each side at once. A value of `a`
+// can only match within the current block of `b`, because the side with
+// the smaller maximum is the one that moves on.
+__attribute__((target("sse4.2")))
+std::size_t mergeSSE42(const std::int64_t* a, std::size_t na,
+                       const std::int64_t* b, std::size_t nb,
+                       std::int64_t* out)
+{
+    std::size_t i = 0, j = 0, k = 0;
+
+    while (i + 2 <= na && j + 2 <= nb)
+    {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + j));
+        __m128i vbSwapped = _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2));
+
+        __m128i eq = _mm_or_si128(_mm_cmpeq_epi64(va, vb),
+                                  _mm_cmpeq_epi64(va, vbSwapped));
+        int mask = _mm_movemask_pd(_mm_castsi128_pd(eq));
+
+        if (mask & 1) out[k++] = a[i];
+        if (mask & 2) out[k++] = a[i + 1];
+
+        std::int64_t amax = a[i + 1];
+        std::int64_t bmax = b[j + 1];
+        if (amax <= bmax) i += 2;
+        if (bmax <= amax) j += 2;
+    }
+
+    return mergeTail(a, na, i, b, nb, j, out, k);
+}
+
+
+// The same with blocks of four, comparing `a` against every rotation of
+// the block of `b`.
+__attribute__((target("avx2")))
+std::size_t mergeAVX2(const std::int64_t* a, std::size_t na,
+                      const std::int64_t* b, std::size_t nb,
+                      std::int64_t* out)
+{
+    std::size_t i = 0, j = 0, k = 0;
+
+    while (i + 4 <= na && j + 4 <= nb)
+    {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + j));
+
+        __m256i eq = _mm256_cmpeq_epi64(va, vb);
+        eq = _mm256_or_si256(eq, _mm256_cmpeq_epi64(va,
+                                    _mm256_permute4x64_epi64(vb, 0x39)));
+        eq = _mm256_or_si256(eq, _mm256_cmpeq_epi64(va,
+                                    _mm256_permute4x64_epi64(vb, 0x4E)));
+        eq = _mm256_or_si256(eq, _mm256_cmpeq_epi64(va,
+                                    _mm256_permute4x64_epi64(vb, 0x93)));
+
+        int mask = _mm256_movemask_pd(_mm256_castsi256_pd(eq));
+        while (mask)
+        {
+            int lane = __builtin_ctz(mask);
+            out[k++] = a[i + lane];
+            mask &= mask - 1;
+        }
+
+        std::int64_t amax = a[i + 3];
+        std::int64_t bmax = b[j + 3];
+        if (amax <= bmax) i += 4;
+        if (bmax <= amax) j += 4;
+    }
+
+    return mergeTail(a, na, i, b, nb, j, out, k);
+}
+
+#endif // INTERSECT_X86
+
+} // namespace
+
+
+intersect::Kernel intersect::bestKernel()
+{
+    static const Kernel kernel = []()
+    {
+        if (isSupported(Kernel::AVX2)) {
+            return Kernel::AVX2;
+        }
+        if (isSupported(Kernel::SSE42)) {
+            return Kernel::SSE42;
+        }
+        return Kernel::SCALAR;
+    }();
+    return kernel;
+}
+
+
+bool intersect::isSupported(Kernel kernel)
+{
+    switch (kernel)
+    {
+    case Kernel::SCALAR:
+        return true;
+#ifdef INTERSECT_X86
+    case Kernel::SSE42:
+        return __builtin_cpu_supports("sse4.2");
+    case Kernel::AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+
+std::size_t intersect::merge(Kernel kernel,
+                             const std::int64_t* a, std::size_t na,
+                             const std::int64_t* b, std::size_t nb,
+                             std::int64_t* out)
+{
+    switch (kernel)
+    {
+#ifdef INTERSECT_X86
+    case Kernel::SSE42:
+        return mergeSSE42(a, na, b, nb, out);
+    case Kernel::AVX2:
+        return mergeAVX2(a, na, b, nb, out);
+#endif
+    default:
+        return mergeScalar(a, na, b, nb, out);
+    }
+}
+
+
+std::size_t intersect::gallop(const std::int64_t* small, std::size_t nsmall,
+                              const std::int64_t* large, std::size_t nlarge,
+                              std::int64_t* out)
+{
+    std::size_t k = 0;
+    std::size_t lo = 0;
+
+    for (std::size_t i = 0; i < nsmall && lo < nlarge; ++i)
+    {
+        std::int64_t value = small[i];
+
+        // Double the step until large[hi] is not less than the value.
+        std::size_t step = 1;
+        std::size_t hi = lo;
+        while (hi < nlarge && large[hi] < value) {
+            lo = hi + 1;
+            hi += step;
+            step *= 2;
+        }
+        hi = std::min(hi + 1, nlarge);
+
+        lo = std::lower_bound(large + lo, large + hi, value) - large;
+        if (lo < nlarge && large[lo] == value) {
+            out[k++] = value;
+            ++lo;
+        }
+    }
+    return k;
+}
+
+
+std::size_t intersectSorted(const std::int64_t* a, std::size_t na,
+                            const std::int64_t* b, std::size_t nb,
+                            std::int64_t* out)
+{
+    if (na * GALLOP_RATIO < nb) {
+        return intersect::gallop(a, na, b, nb, out);
+    }
+    if (nb * GALLOP_RATIO < na) {
+        return intersect::gallop(b, nb, a, na, out);
+    }
+    return intersect::merge(intersect::bestKernel(), a, na, b, nb, out);
+}
@@ -0,0 +1,44 @@
+#ifndef INTERSECT_H
+#define INTERSECT_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Intersection of two strictly increasing sequences. The common values
+// are written to `out`, which must have room for min(na, nb) elements.
+// Returns the number of values written.
+//
+// The kernel is chosen once at runtime from the CPU features (AVX2,
+// SSE4.2 or plain scalar code). When one side is much longer than the
+// other, a galloping search over the longer side is used instead.
+std::size_t intersectSorted(const std::int64_t* a, std::size_t na,
+                            const std::int64_t* b, std::size_t nb,
+                            std::int64_t* out);
+
+
+// The individual kernels, exposed for tests and benchmarks. The SIMD ones
+// must only be called when the CPU supports them.
+namespace intersect
+{
+enum class Kernel
+{
+    SCALAR,
+    SSE42,
+    AVX2,
+};
+
+Kernel bestKernel();
+bool isSupported(Kernel kernel);
+
+std::size_t merge(Kernel kernel,
+                  const std::int64_t* a, std::size_t na,
+                  const std::int64_t* b, std::size_t nb,
+                  std::int64_t* out);
+
+std::size_t gallop(const std::int64_t* small, std::size_t nsmall,
+                   const std::int64_t* large, std::size_t nlarge,
+                   std::int64_t* out);
+
+} // namespace intersect
+
+#endif // INTERSECT_H
@@ -0,0 +1,111 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "table.h"
+#include "intersect.h"
+
+// Compares the map-based lookup of findEqualRowsByIndex with the sorted
+// array intersection kernels.
+//
+//   bench_intersect [keys [step1 step2]]
+//
+// Builds two sets of `keys` integers, multiples of step1 and of step2, and
+// intersects them. Also runs a skewed case that takes the galloping path.
+
+using Clock = std::chrono::steady_clock;
+
+template<typename F>
+double measure(F&& f, std::size_t& result)
+{
+    auto start = Clock::now();
+    result = f();
+    std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+    return elapsed.count();
+}
+
+
+void report(const std::string& name, double ms, std::size_t found, double base)
+{
+    std::cout << name << ": " << ms << " ms, " << found << " common keys";
+    if (base > 0) {
+        std::cout << ", x" << base / ms;
+    }
+    std::cout << std::endl;
+}
+
+
+std::vector<std::int64_t> makeKeys(std::size_t count, std::int64_t step)
+{
+    std::vector<std::int64_t> keys(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        keys[i] = std::int64_t(i) * step;
+    }
+    return keys;
+}
+
+
+void run(const std::vector<std::int64_t>& a, const std::vector<std::int64_t>& b)
+{
+    Table::Index<long> index1, index2;
+    for (std::size_t i = 0; i < a.size(); ++i) index1.insert(a[i], i);
+    for (std::size_t i = 0; i < b.size(); ++i) index2.insert(b[i], i);
+
+    std::cout << a.size() << " x " << b.size() << " keys" << std::endl;
+
+    std::size_t found = 0;
+    double base = measure([&]() {
+        std::size_t n = 0;
+        for (long val : index1) {
+            if (index2.find(val) != index2.end()) ++n;
+        }
+        return n;
+    }, found);
+    report("  map find", base, found, 0);
+
+    std::vector<std::int64_t> out(std::min(a.size(), b.size()));
+
+    using intersect::Kernel;
+    const std::pair<Kernel, const char*> kernels[] = {
+        {Kernel::SCALAR, "  scalar  "},
+        {Kernel::SSE42,  "  sse4.2  "},
+        {Kernel::AVX2,   "  avx2    "},
+    };
+    for (auto& kernel : kernels)
+    {
+        if (!intersect::isSupported(kernel.first)) {
+            std::cout << kernel.second << ": not supported" << std::endl;
+            continue;
+        }
+        double ms = measure([&]() {
+            return intersect::merge(kernel.first, a.data(), a.size(),
+                                    b.data(), b.size(), out.data());
+        }, found);
+        report(kernel.second, ms, found, base);
+    }
+
+    double ms = measure([&]() {
+        return intersectSorted(a.data(), a.size(), b.data(), b.size(),
+                               out.data());
+    }, found);
+    report("  dispatch", ms, found, base);
+}
+
+
+int main(int argc, char* argv[])
+{
+    std::size_t keys = 1000000;
+    std::int64_t step1 = 2, step2 = 3;
+
+    if (argc > 1) keys = std::stoul(argv[1]);
+    if (argc > 3) {
+        step1 = std::stol(argv[2]);
+        step2 = std::stol(argv[3]);
+    }
+
+    run(makeKeys(keys, step1), makeKeys(keys, step2));
+    run(makeKeys(keys / 1000 + 1, step1 * 997), makeKeys(keys, step2));
+
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "memstore.h"
+#include "mapped_file.h"
+
+MappedFile::MappedFile(const std::string& path)
+    : m_data(nullptr), m_size(0)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw sql::Exception(fmt::sprintf("cannot open %v: %v", path, 
+                                          std::strerror(errno)));
+    }
+
+    struct stat info;
+    if (::fstat(fd, &info) == 0 && info.st_size > 0) 
+    {
+        m_size = info.st_size;
+        m_data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    int error = errno;
+    ::close(fd);
+
+    if (m_data == MAP_FAILED) {
+        throw sql::Exception(fmt::sprintf("cannot map %v: %v", path, 
+                                          std::strerror(error)));
+    }
+    if (m_data) {
+        ::madvise(m_data, m_size, MADV_SEQUENTIAL);
+    }
+}
+
+
+MappedFile::~MappedFile()
+{
+    if (m_data) ::munmap(m_data, m_size);
+}
+
+
+void syncDirectoryOf(const std::string& path)
+{
+    auto slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." 
+                    : slash == 0                 ? "/" 
+                                                 : path.substr(0, slash);
+
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0 || ::fsync(fd) != 0) 
+    {
+        int error = errno;
+        if (fd >= 0) ::close(fd);
+        throw sql::Exception(fmt::sprintf("cannot sync directory %v: %v", dir, 
+                                          std::strerror(error)));
+    }
+    ::close(fd);
+}
@@ -0,0 +1,30 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+// A whole file mapped read-only into memory, for reading it once from 
+// start to end. An empty file maps to no data.
+class MappedFile
+{
+    void*       m_data;
+    std::size_t m_size;
+
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator= (const MappedFile&) = delete;
+
+    const char* data() const noexcept { return static_cast<const char*>(m_data); }
+    std::size_t size() const noexcept { return m_size; }
+};
+
+
+// Flushes the directory holding the file to disk, so that a file just
+// created or renamed there is still found after a crash. Throws on error.
+void syncDirectoryOf(const std::string& path);
+
+#endif // MAPPED_FILE_H
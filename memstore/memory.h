@@ -0,0 +1,136 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "memstore.h"
+
+// Accounting of the memory a Memstore holds: rows, index nodes and the
+// results of queries. Sizes are what is asked of the allocator, without
+// its own overhead.
+namespace memory
+{
+// Bytes in use, also added to the parent's. With a limit set, check()
+// refuses what would not fit under it.
+class Counter
+{
+    std::shared_ptr<Counter>  m_parent;
+    std::atomic<std::size_t>  m_bytes{0};
+    std::atomic<std::size_t>  m_limit{0};
+
+public:
+    explicit Counter(std::shared_ptr<Counter> parent = nullptr)
+        : m_parent(std::move(parent)) {}
+
+    void add(std::size_t bytes)
+    {
+        m_bytes.fetch_add(bytes, std::memory_order_relaxed);
+        if (m_parent) m_parent->add(bytes);
+    }
+
+    void sub(std::size_t bytes)
+    {
+        m_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+        if (m_parent) m_parent->sub(bytes);
+    }
+
+    std::size_t bytes() const {
+        return m_bytes.load(std::memory_order_relaxed);
+    }
+
+    // 0 for no limit.
+    std::size_t limit() const {
+        return m_limit.load(std::memory_order_relaxed);
+    }
+    void setLimit(std::size_t limit) {
+        m_limit.store(limit, std::memory_order_relaxed);
+    }
+
+    // Throws unless `more` bytes still fit under the limit.
+    void check(std::size_t more = 0) const
+    {
+        std::size_t max = limit();
+        if (max != 0 && bytes() + more > max) {
+            throw sql::Exception(
+                fmt::sprintf("memory limit of %v bytes reached", max));
+        }
+    }
+};
+
+
+// Bytes held by one object, given back to the counter when it goes.
+class Charge
+{
+    std::shared_ptr<Counter>  m_counter;
+    std::atomic<std::size_t>  m_bytes{0};
+
+public:
+    explicit Charge(std::shared_ptr<Counter> counter = nullptr,
+                    std::size_t bytes = 0)
+        : m_counter(std::move(counter))
+    {
+        add(bytes);
+    }
+
+    Charge(Charge&& other)
+        : m_counter(std::move(other.m_counter)),
+          m_bytes(other.m_bytes.exchange(0)) {}
+
+    Charge& operator= (Charge&& other)
+    {
+        if (this != &other)
+        {
+            release();
+            m_counter = std::move(other.m_counter);
+            m_bytes = other.m_bytes.exchange(0);
+        }
+        return *this;
+    }
+
+    ~Charge() { release(); }
+
+    void add(std::size_t bytes)
+    {
+        m_bytes.fetch_add(bytes, std::memory_order_relaxed);
+        if (m_counter) m_counter->add(bytes);
+    }
+
+    void sub(std::size_t bytes)
+    {
+        m_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+        if (m_counter) m_counter->sub(bytes);
+    }
+
+    std::size_t bytes() const {
+        return m_bytes.load(std::memory_order_relaxed);
+    }
+
+private:
+    void release()
+    {
+        if (m_counter) m_counter->sub(m_bytes.exchange(0));
+        m_counter.reset();
+    }
+};
+
+
+// Heap behind a value beyond the object itself; short strings are kept
+// inside it.
+inline std::size_t heapBytes(long) { return 0; }
+
+inline std::size_t heapBytes(const std::string& s)
+{
+    static const std::size_t inPlace = std::string().capacity();
+    return s.capacity() > inPlace ? s.capacity() + 1 : 0;
+}
+
+// A node of std::map or std::set: color and three links, then the value.
+template<typename V>
+constexpr std::size_t treeNodeBytes() { return 4 * sizeof(void*) + sizeof(V); }
+
+} // namespace memory
+
+#endif // MEMORY_H
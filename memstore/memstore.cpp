@@ -6,15 +6,18 @@ class Connection : public sql::IDBConnection
 {
     Memstore m_db;
 public:
-    sql::IStatement* createStatement() override {
-        return new Statement(&m_db);
+    explicit Connection(const mem::Options& options) : m_db(options) {}
+
+    sql::IStatement* createStatement(
+                        std::pmr::memory_resource* memory) override {
+        return new Statement(&m_db, memory);
     }
 
     void close() override {}
 };
 
 
-sql::IDBConnection* mem::open() {
-    return new Connection();
+sql::IDBConnection* mem::open(const mem::Options& options) {
+    return new Connection(options);
 }
 
@@ -5,7 +5,42 @@
 #include "../util/util.h"
 
 namespace mem {
-    sql::IDBConnection* open();
+    // When a change logged to the write-ahead log is acknowledged.
+    enum class Durability
+    {
+        SYNC,       // after it is on disk; concurrent writers share an fsync
+        BATCH,      // at once, the flusher syncs as soon as it can
+        INTERVAL    // at once, the flusher syncs every walIntervalMs
+    };
+
+    struct Options
+    {
+        // Threads used by a single join, 0 means one per core.
+        std::size_t joinThreads = 0;
+
+        // Shards of each new table. Rows are spread by the hash of their
+        // primary key, and every shard has its own lock.
+        std::size_t tableShards = 1;
+
+        // Write-ahead log replayed on open and appended to by every 
+        // change; empty keeps the data in memory only.
+        std::string walPath;
+        Durability  durability = Durability::SYNC;
+        std::size_t walIntervalMs = 100;
+
+        // Snapshot file loaded on open and written by the SNAPSHOT 
+        // command, and every snapshotIntervalSec seconds unless that is 0.
+        // Log entries the snapshot already includes are not replayed.
+        std::string snapshotPath;
+        std::size_t snapshotIntervalSec = 0;
+
+        // Bytes of rows, indices and join results past which inserts, 
+        // loads, index builds and joins fail instead of allocating; 
+        // 0 for no limit.
+        std::size_t memoryLimit = 0;
+    };
+
+    sql::IDBConnection* open(const Options& options = Options());
 }
 
 #endif // MEMSTORE_H
\ No newline at end of file
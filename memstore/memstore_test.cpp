@@ -0,0 +1,1190 @@
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <random>
+#include <set>
+#include <thread>
+#include <sys/resource.h>
+#include <gtest/gtest.h>
+#include "memstore.h"
+#include "intersect.h"
+#include "radix_join.h"
+#include "join_planner.h"
+
+class MemstoreTest : public ::testing::Test
+{
+protected:
+    std::unique_ptr<sql::IDBConnection> m_conn;
+    std::unique_ptr<sql::IStatement>    m_statement;
+
+    void SetUp() override 
+    {
+        m_conn.reset(mem::open());
+        m_statement.reset(m_conn->createStatement());
+        modify("CREATE TABLE A (id INTEGER PRIMARY KEY, name TEXT);");
+        modify("CREATE TABLE B (id INTEGER PRIMARY KEY, name TEXT);");
+    }
+
+    void modify(const std::string& query) {
+        m_statement->modify(query);
+    }
+
+    void insert(const std::string& table, long id, const std::string& name) {
+        modify(fmt::sprintf("INSERT INTO %v VALUES (%v, \"%v\");", 
+                            table, id, name));
+    }
+
+    // Returns rows as "c0,c1,..." with empty strings for NULLs.
+    std::vector<std::string> select(const std::string& query, 
+                                    const std::vector<sql::DataType>& types)
+    {
+        std::vector<std::string> rows;
+        sql::ISelection *selection = m_statement->select(query);
+        for (; !selection->end(); selection->next()) 
+        {
+            std::string row;
+            for (std::size_t i = 0; i < types.size(); ++i) 
+            {
+                if (i != 0) row += ",";
+                if (selection->isNull(i)) continue;
+                if (types[i] == sql::DataType::INTEGER) {
+                    row += std::to_string(selection->getLong(i));
+                } 
+                else {
+                    row += selection->getString(i);
+                }
+            }
+            rows.push_back(row);
+        }
+        selection->close();
+        return rows;
+    }
+
+    const std::vector<sql::DataType> joinTypes = {
+        sql::DataType::INTEGER, sql::DataType::TEXT,
+        sql::DataType::INTEGER, sql::DataType::TEXT
+    };
+
+    const std::string innerJoinOnName = 
+        "SELECT * FROM A JOIN B ON A.name = B.name;";
+    
+    const std::string symdiffOnName = 
+        "SELECT * FROM A FULL OUTER JOIN B ON A.name = B.name "
+        "WHERE A.name IS NULL OR B.name IS NULL;";
+
+    void fillNames()
+    {
+        insert("A", 1, "x");
+        insert("A", 2, "y");
+        insert("A", 3, "z");
+        insert("B", 10, "y");
+        insert("B", 11, "w");
+        insert("B", 12, "y");
+    }
+};
+
+
+TEST_F(MemstoreTest, innerJoinOnNonKeyColumn)
+{
+    fillNames();
+    std::vector<std::string> expect = {"2,y,10,y", "2,y,12,y"};
+
+    EXPECT_EQ(expect, select(innerJoinOnName, joinTypes));
+
+    modify("CREATE INDEX ON B(name);");
+    EXPECT_EQ(expect, select(innerJoinOnName, joinTypes));
+
+    modify("CREATE INDEX a_name ON A (name);");
+    EXPECT_EQ(expect, select(innerJoinOnName, joinTypes));
+}
+
+
+TEST_F(MemstoreTest, hashJoinKeepsOrderForEitherBuildSide)
+{
+    fillNames();
+    insert("B", 13, "x");
+    insert("B", 14, "v");
+    EXPECT_EQ((std::vector<std::string>{"1,x,13,x", "2,y,10,y", "2,y,12,y"}),
+              select(innerJoinOnName, joinTypes));
+
+    insert("A", 4, "y");
+    insert("A", 5, "u");
+    insert("A", 6, "t");
+    EXPECT_EQ((std::vector<std::string>{
+                    "1,x,13,x", "2,y,10,y", "2,y,12,y", "4,y,10,y", "4,y,12,y"}),
+              select(innerJoinOnName, joinTypes));
+}
+
+
+TEST_F(MemstoreTest, symdiffOnNonKeyColumn)
+{
+    fillNames();
+    std::vector<std::string> expect = {"1,x,,", "3,z,,", ",,11,w"};
+
+    EXPECT_EQ(expect, select(symdiffOnName, joinTypes));
+
+    modify("CREATE INDEX ON A(name);");
+    EXPECT_EQ(expect, select(symdiffOnName, joinTypes));
+
+    // With both columns indexed the rows come out in key order.
+    modify("CREATE INDEX ON B(name);");
+    EXPECT_EQ((std::vector<std::string>{",,11,w", "1,x,,", "3,z,,"}),
+              select(symdiffOnName, joinTypes));
+}
+
+
+TEST_F(MemstoreTest, indexFollowsInsertAndTruncate)
+{
+    modify("CREATE INDEX ON A(name);");
+    modify("CREATE INDEX ON B(name);");
+    fillNames();
+    EXPECT_EQ(2u, select(innerJoinOnName, joinTypes).size());
+
+    modify("DELETE FROM B;");
+    EXPECT_TRUE(select(innerJoinOnName, joinTypes).empty());
+
+    insert("B", 20, "z");
+    EXPECT_EQ(std::vector<std::string>{"3,z,20,z"}, 
+              select(innerJoinOnName, joinTypes));
+}
+
+
+TEST_F(MemstoreTest, selectList)
+{
+    fillNames();
+    const std::vector<sql::DataType> types = {
+        sql::DataType::TEXT, sql::DataType::INTEGER, sql::DataType::TEXT
+    };
+
+    EXPECT_EQ((std::vector<std::string>{"y,2,y", "y,2,y"}),
+              select("SELECT B.name, A.id, name FROM A JOIN B ON A.name = B.name;",
+                     types));
+
+    EXPECT_EQ((std::vector<std::string>{"x,1", "y,2", "z,3"}),
+              select("SELECT name, A.id FROM A;", 
+                     {sql::DataType::TEXT, sql::DataType::INTEGER}));
+
+    EXPECT_THROW(select("SELECT A.age FROM A JOIN B ON A.id = B.id;", types),
+                 sql::Exception);
+    EXPECT_THROW(select("SELECT C.id FROM A;", types), sql::Exception);
+    EXPECT_THROW(select("SELECT FROM A;", types), sql::Exception);
+    EXPECT_THROW(select("SELECT id, FROM A;", types), sql::Exception);
+}
+
+
+TEST_F(MemstoreTest, batchesMatchRows)
+{
+    fillNames();
+    insert("A", 4, "v");
+    modify("DELETE FROM A WHERE id = 2;");
+
+    // Returns the rows of every batch as "c0,c1,...", and the batch sizes.
+    auto batches = [this](const std::string& query, 
+                          std::vector<std::size_t>& sizes) {
+        std::vector<std::string> rows;
+        sql::ColumnBatch batch(2);
+        sql::ISelection *selection = m_statement->select(query);
+        while (selection->nextBatch(batch) != 0) 
+        {
+            sizes.push_back(batch.size());
+            for (std::size_t r = 0; r < batch.size(); ++r) 
+            {
+                std::string row;
+                for (std::size_t c = 0; c < batch.columnCount(); ++c) 
+                {
+                    if (c != 0) row += ",";
+                    if (batch.isNull(c, r)) continue;
+                    row += c % 2 == 0 ? std::to_string(batch.getLong(c, r))
+                                      : std::string(batch.getString(c, r));
+                }
+                rows.push_back(row);
+            }
+        }
+        EXPECT_TRUE(selection->end());
+        selection->close();
+        return rows;
+    };
+
+    std::vector<std::size_t> sizes;
+    EXPECT_EQ((std::vector<std::string>{"1,x", "3,z", "4,v"}),
+              batches("SELECT * FROM A;", sizes));
+    EXPECT_EQ((std::vector<std::size_t>{2, 1}), sizes);
+
+    sizes.clear();
+    EXPECT_EQ(select(symdiffOnName, joinTypes), batches(symdiffOnName, sizes));
+    EXPECT_EQ((std::vector<std::size_t>{2, 2, 2}), sizes);
+}
+
+
+TEST_F(MemstoreTest, explain)
+{
+    fillNames();
+    const std::vector<sql::DataType> types = {
+        sql::DataType::TEXT, sql::DataType::TEXT, 
+        sql::DataType::INTEGER, sql::DataType::INTEGER
+    };
+
+    // Planned only: no times, and no rows past the scans.
+    EXPECT_EQ((std::vector<std::string>{
+                    "materialize,A and B,6,", "scan,A: full scan,3,",
+                    "scan,B: full scan,3,", "join,nested loop,,"}),
+              select("EXPLAIN " + innerJoinOnName, types));
+
+    modify("CREATE INDEX ON B(name);");
+    std::vector<std::string> stages;
+    for (const std::string& line : select("EXPLAIN ANALYZE " + innerJoinOnName, 
+                                          types)) {
+        stages.push_back(line.substr(0, line.rfind(',')));
+    }
+    EXPECT_EQ((std::vector<std::string>{
+                    "materialize,A and B,6", "scan,A: full scan,3",
+                    "scan,B.name: index,3", 
+                    "join,index lookup into second,2",
+                    "selection,row ids,2", "serialize,18 bytes,2"}),
+              stages);
+
+    EXPECT_THROW(select("EXPLAIN DELETE FROM A;", types), sql::Exception);
+}
+
+
+TEST_F(MemstoreTest, createIndexErrors)
+{
+    EXPECT_THROW(modify("CREATE INDEX ON C(name);"), sql::Exception);
+    EXPECT_THROW(modify("CREATE INDEX ON A(age);"), sql::Exception);
+    EXPECT_THROW(modify("CREATE INDEX ON A(id);"), sql::Exception);
+}
+
+
+TEST_F(MemstoreTest, unknownTables)
+{
+    EXPECT_THROW(modify("CREATE TABLE A (id INTEGER PRIMARY KEY);"), 
+                 sql::Exception);
+    EXPECT_THROW(modify("DELETE FROM C;"), sql::Exception);
+    EXPECT_THROW(modify("INSERT INTO C VALUES (1, \"x\");"), sql::Exception);
+    EXPECT_THROW(select("SELECT * FROM A JOIN C ON A.id = C.id;", joinTypes),
+                 sql::Exception);
+
+    // A failed lookup must not leave an empty table behind.
+    modify("CREATE TABLE C (id INTEGER PRIMARY KEY, name TEXT);");
+    insert("C", 1, "x");
+}
+
+
+TEST_F(MemstoreTest, deleteRows)
+{
+    fillNames();
+    sql::ISelection *before = m_statement->select("SELECT id FROM A;");
+
+    std::unique_ptr<sql::IStatement> writer(m_conn->createStatement());
+    writer->modify("DELETE FROM A WHERE id = 2;");
+    writer->modify("DELETE FROM B WHERE name = \"y\";");
+    writer->modify("DELETE FROM B WHERE id = 99;");
+    EXPECT_THROW(writer->modify("DELETE FROM B WHERE age = 1;"), 
+                 sql::Exception);
+    EXPECT_THROW(writer->modify("DELETE FROM B WHERE id;"), sql::Exception);
+
+    std::vector<long> ids;
+    for (; !before->end(); before->next()) {
+        ids.push_back(before->getLong(0));
+    }
+    before->close();
+    EXPECT_EQ((std::vector<long>{1, 2, 3}), ids);
+
+    EXPECT_EQ((std::vector<std::string>{"1", "3"}), 
+              select("SELECT id FROM A;", {sql::DataType::INTEGER}));
+    EXPECT_EQ((std::vector<std::string>{"1,x,,", "3,z,,", ",,11,w"}), 
+              select(symdiffOnName, joinTypes));
+
+    insert("A", 2, "w");
+    EXPECT_EQ((std::vector<std::string>{"2,w,11,w"}), 
+              select(innerJoinOnName, joinTypes));
+
+    modify("CREATE INDEX ON A(name);");
+    modify("CREATE INDEX ON B(name);");
+    modify("DELETE FROM B WHERE name = \"w\";");
+    EXPECT_TRUE(select(innerJoinOnName, joinTypes).empty());
+}
+
+
+TEST(table, compaction)
+{
+    Schema schema;
+    schema.addColumn(ColumnInfo("id", sql::DataType::INTEGER, true));
+    schema.addColumn(ColumnInfo("name", sql::DataType::TEXT, false));
+
+    Table table(schema);
+    table.createIndex(1);
+    for (long i = 0; i < 10; ++i) {
+        table.insert({DataObject(i), DataObject("n" + std::to_string(i % 3))});
+    }
+    EXPECT_EQ(4u, table.removeWhere(1, DataObject(std::string("n0"))));
+    EXPECT_EQ(1u, table.removeWhere(0, DataObject(5L)));
+    EXPECT_EQ(5u, table.tombstones());
+
+    Table::Snapshot before = table.snapshot();
+
+    auto stale = table.compacted();
+    table.insert({DataObject(10L), DataObject(std::string("n1"))});
+    EXPECT_EQ(nullptr, table.install(std::move(stale)));
+
+    // The old rows and indices are handed back to be freed.
+    auto retired = table.install(table.compacted());
+    ASSERT_NE(nullptr, retired);
+    EXPECT_EQ(11u, retired->store->size());
+    EXPECT_EQ(2u, retired->indices.size());
+    EXPECT_EQ(0u, table.tombstones());
+    EXPECT_EQ(6u, table.size());
+
+    std::vector<long> ids;
+    for (auto row : table.snapshot()) ids.push_back(row.cast<long>(0));
+    EXPECT_EQ((std::vector<long>{1, 2, 4, 7, 8, 10}), ids);
+    EXPECT_EQ((std::vector<Table::RowID>{0, 2, 3, 5}), 
+              table.index<std::string>(1)->rows("n1"));
+
+    // The old rows stay readable through the snapshot.
+    EXPECT_EQ(10u, before.size());
+    EXPECT_TRUE(before.isRemoved(0));
+    EXPECT_EQ("n2", before.getString(5, 1));
+}
+
+
+TEST(table, dictionaryEncoding)
+{
+    Schema schema;
+    schema.addColumn(ColumnInfo("id", sql::DataType::INTEGER, true));
+    schema.addColumn(ColumnInfo("tag", sql::DataType::TEXT, false, true));
+    schema.addColumn(ColumnInfo("name", sql::DataType::TEXT, false));
+
+    auto dictionary = std::make_shared<Table::Dictionary>();
+    Table table(schema, nullptr, dictionary);
+    EXPECT_TRUE(table.isEncoded(1));
+    EXPECT_FALSE(table.isEncoded(2));
+
+    const long rows = 6000;
+    for (long i = 0; i < rows; ++i)
+    {
+        std::string name = "a name too long to be kept in place " +
+                           std::to_string(i % 10);
+        table.insert({DataObject(i), DataObject("t" + std::to_string(i % 4)),
+                      DataObject(name)});
+    }
+    EXPECT_EQ(4u, dictionary->size());
+    EXPECT_EQ(0u, table.removeWhere(1, DataObject(std::string("t9"))));
+    EXPECT_EQ(size_t(rows / 4),
+              table.removeWhere(1, DataObject(std::string("t3"))));
+
+    // Ten names in many rows: compaction encodes them too.
+    EXPECT_TRUE(table.wantsEncoding());
+    EXPECT_NE(nullptr, table.install(table.compacted()));
+    EXPECT_TRUE(table.isEncoded(2));
+    EXPECT_FALSE(table.wantsEncoding());
+    EXPECT_EQ(14u, dictionary->size());
+    // "t3" went with the rows removed above.
+    EXPECT_EQ(1u, dictionary->sweep());
+    EXPECT_EQ(13u, dictionary->size());
+
+    Table::Snapshot snapshot = table.snapshot();
+    EXPECT_EQ("t1", snapshot.getString(1, 1));
+    EXPECT_EQ("a name too long to be kept in place 1",
+              snapshot.getString(1, 2));
+    // Rows 0 and 8 are ids 0 and 10, once 3 and 7 are gone.
+    EXPECT_EQ(snapshot[0].cast<Table::Code>(2),
+              snapshot[8].cast<Table::Code>(2));
+    EXPECT_NE(snapshot[0].cast<Table::Code>(2),
+              snapshot[1].cast<Table::Code>(2));
+
+    // Truncate forgets what compaction encoded; the entries stay while
+    // the snapshot holds the old rows.
+    table.truncate();
+    EXPECT_TRUE(table.isEncoded(1));
+    EXPECT_FALSE(table.isEncoded(2));
+    EXPECT_EQ(0u, dictionary->sweep());
+    snapshot = Table::Snapshot();
+    EXPECT_EQ(13u, dictionary->sweep());
+    EXPECT_EQ(0u, dictionary->bytes());
+
+    table.insert({DataObject(1L), DataObject(std::string("t1")),
+                  DataObject(std::string("x"))});
+    EXPECT_EQ(1u, dictionary->size());
+    EXPECT_EQ("t1", table.snapshot().getString(0, 1));
+}
+
+
+TEST_F(MemstoreTest, joinsOnDictionaryCodes)
+{
+    modify("CREATE TABLE C (id INTEGER PRIMARY KEY, name TEXT DICTIONARY);");
+    modify("CREATE TABLE D (id INTEGER PRIMARY KEY, name TEXT dictionary);");
+    EXPECT_THROW(modify("CREATE TABLE E (id INTEGER DICTIONARY);"),
+                 sql::Exception);
+    for (std::string table : {"C", "D"})
+    {
+        insert(table, 1, "x");
+        insert(table, 2, table == "C" ? "y" : "z");
+    }
+
+    const std::vector<sql::DataType> types = {
+        sql::DataType::TEXT, sql::DataType::TEXT,
+        sql::DataType::INTEGER, sql::DataType::INTEGER
+    };
+    EXPECT_EQ("join,nested loop on codes,,",
+              select("EXPLAIN SELECT * FROM C JOIN D ON C.name = D.name;",
+                     types).back());
+    EXPECT_EQ((std::vector<std::string>{"1,x,1,x"}),
+              select("SELECT * FROM C JOIN D ON C.name = D.name;", joinTypes));
+    EXPECT_EQ((std::vector<std::string>{"2,y,,", ",,2,z"}),
+              select("SELECT * FROM C FULL OUTER JOIN D ON C.name = D.name "
+                     "WHERE C.name IS NULL OR D.name IS NULL;", joinTypes));
+
+    modify("DELETE FROM D WHERE name = \"x\";");
+    EXPECT_TRUE(select("SELECT * FROM C JOIN D ON C.name = D.name;",
+                       joinTypes).empty());
+}
+
+
+TEST(table, truncateRetiresStorage)
+{
+    Schema schema;
+    schema.addColumn(ColumnInfo("id", sql::DataType::INTEGER, true));
+
+    Table table(schema);
+    for (long i = 0; i < 3; ++i) table.insert({DataObject(i)});
+    Table::Snapshot before = table.snapshot();
+
+    auto retired = table.truncate();
+    EXPECT_EQ(0u, table.size());
+    EXPECT_EQ(table.index<long>(0)->begin(), table.index<long>(0)->end());
+    EXPECT_EQ(3u, retired->store->size());
+    EXPECT_EQ(1u, retired->indices.size());
+
+    table.insert({DataObject(1L)});
+    retired.reset();
+    EXPECT_EQ(2, before.getLong(2, 0));
+}
+
+
+TEST(shards, joinsAcrossShards)
+{
+    mem::Options options;
+    options.tableShards = 4;
+    std::unique_ptr<sql::IDBConnection> conn(mem::open(options));
+    std::unique_ptr<sql::IStatement> statement(conn->createStatement());
+
+    statement->modify("CREATE TABLE A (id INTEGER PRIMARY KEY, name TEXT);");
+    statement->modify("CREATE TABLE B (id INTEGER PRIMARY KEY, name TEXT);");
+
+    std::vector<std::thread> producers;
+    for (long p = 0; p < 4; ++p) 
+    {
+        producers.emplace_back([&conn, p]() {
+            std::unique_ptr<sql::IStatement> st(conn->createStatement());
+            for (long id = p; id < 400; id += 4) {
+                st->modify(fmt::sprintf("INSERT INTO A VALUES (%v, \"a%v\");", 
+                                        id, id % 50));
+            }
+        });
+    }
+    for (auto& producer : producers) producer.join();
+
+    for (long id = 0; id < 600; id += 3) {
+        statement->modify(fmt::sprintf("INSERT INTO B VALUES (%v, \"a%v\");", 
+                                       id, id % 70));
+    }
+    EXPECT_THROW(statement->modify("INSERT INTO A VALUES (7, \"x\");"), 
+                 sql::Exception);
+
+    auto rows = [&](const std::string& query, std::size_t width) {
+        std::multiset<std::string> result;
+        sql::ISelection *selection = statement->select(query);
+        for (; !selection->end(); selection->next()) 
+        {
+            std::string row;
+            for (std::size_t i = 0; i < width; ++i) {
+                row += selection->isNull(i) ? "-" : selection->getString(i);
+                row += " ";
+            }
+            result.insert(row);
+        }
+        selection->close();
+        return result;
+    };
+
+    std::multiset<std::string> expect;
+    for (long id = 0; id < 400; id += 3) {
+        expect.insert(fmt::sprintf("a%v a%v ", id % 50, id % 70));
+    }
+    EXPECT_EQ(expect, rows("SELECT A.name, B.name FROM A JOIN B ON A.id = B.id;", 
+                           2));
+
+    expect.clear();
+    for (long id = 0; id < 400; ++id) {
+        if (id % 3) expect.insert(fmt::sprintf("a%v - ", id % 50));
+    }
+    for (long id = 402; id < 600; id += 3) {
+        expect.insert(fmt::sprintf("- a%v ", id % 70));
+    }
+    EXPECT_EQ(expect, rows("SELECT A.name, B.name FROM A FULL OUTER JOIN B "
+                           "ON A.id = B.id WHERE A.id IS NULL OR B.id IS NULL;", 
+                           2));
+
+    // Not on the shard key: the shards are joined as one table.
+    std::map<long, std::size_t> names2;
+    for (long id = 0; id < 600; id += 3) ++names2[id % 70];
+    std::size_t pairs = 0;
+    for (long id = 0; id < 400; ++id) pairs += names2[id % 50];
+    EXPECT_EQ(pairs, rows("SELECT A.name FROM A JOIN B ON A.name = B.name;", 
+                          1).size());
+    EXPECT_EQ(400u, rows("SELECT name FROM A;", 1).size());
+
+    statement->modify("DELETE FROM A;");
+    EXPECT_TRUE(rows("SELECT name FROM A;", 1).empty());
+}
+
+
+TEST(wal, replaysAfterRestart)
+{
+    mem::Options options;
+    options.tableShards = 2;
+    options.walPath = ::testing::TempDir() + "memstore_test.wal";
+    std::remove(options.walPath.c_str());
+
+    auto names = [](sql::IDBConnection* conn) {
+        std::unique_ptr<sql::IStatement> statement(conn->createStatement());
+        std::set<std::string> result;
+        sql::ISelection *selection = statement->select("SELECT * FROM A;");
+        for (; !selection->end(); selection->next()) {
+            result.insert(std::to_string(selection->getLong(0)) + 
+                          selection->getString(1));
+        }
+        selection->close();
+        return result;
+    };
+
+    {
+        std::unique_ptr<sql::IDBConnection> conn(mem::open(options));
+        std::unique_ptr<sql::IStatement> statement(conn->createStatement());
+        statement->modify("CREATE TABLE IF NOT EXISTS A (id INTEGER PRIMARY KEY, name TEXT);");
+        statement->modify("INSERT INTO A VALUES (1, \"gone\");");
+        statement->modify("DELETE FROM A;");
+        for (long id = 0; id < 6; ++id) {
+            statement->modify(fmt::sprintf("INSERT INTO A VALUES (%v, \"a%v\");", 
+                                           id, id % 2));
+        }
+        EXPECT_THROW(statement->modify("INSERT INTO A VALUES (3, \"dup\");"), 
+                     sql::Exception);
+        statement->modify("CREATE INDEX ON A(name);");
+        statement->modify("DELETE FROM A WHERE name = \"a1\";");
+        statement->modify("DELETE FROM A WHERE id = 2;");
+    }
+
+    // A write torn by a crash.
+    std::size_t intact;
+    {
+        std::ofstream log(options.walPath, std::ios::binary | std::ios::app);
+        intact = log.tellp();
+        const char torn[] = "\x30\0\0\0garbage";
+        log.write(torn, sizeof(torn) - 1);
+    }
+
+    std::unique_ptr<sql::IDBConnection> conn(mem::open(options));
+    std::unique_ptr<sql::IStatement> statement(conn->createStatement());
+    statement->modify("CREATE TABLE IF NOT EXISTS A (id INTEGER PRIMARY KEY, name TEXT);");
+    EXPECT_EQ(std::set<std::string>({"0a0", "4a0"}), names(conn.get()));
+    EXPECT_EQ(intact, std::ifstream(options.walPath, std::ios::ate).tellg());
+
+    statement->modify("INSERT INTO A VALUES (7, \"b\");");
+    conn.reset(mem::open(options));
+    EXPECT_EQ(std::set<std::string>({"0a0", "4a0", "7b"}), names(conn.get()));
+
+    conn.reset();
+    std::remove(options.walPath.c_str());
+}
+
+
+// Once a write of the log fails, changes are refused before they are 
+// applied rather than applied without being logged.
+TEST(wal, failedLogRefusesChanges)
+{
+    mem::Options options;
+    options.walPath = ::testing::TempDir() + "memstore_failed_test.wal";
+    std::remove(options.walPath.c_str());
+
+    std::unique_ptr<sql::IDBConnection> conn(mem::open(options));
+    std::unique_ptr<sql::IStatement> statement(conn->createStatement());
+    statement->modify("CREATE TABLE A (id INTEGER PRIMARY KEY, name TEXT);");
+
+    // The file cannot grow past its current size.
+    rlimit saved;
+    ::getrlimit(RLIMIT_FSIZE, &saved);
+    auto handler = std::signal(SIGXFSZ, SIG_IGN);
+    rlimit limit = saved;
+    limit.rlim_cur = std::ifstream(options.walPath, std::ios::ate).tellg();
+    ::setrlimit(RLIMIT_FSIZE, &limit);
+
+    // The first insert is applied and its commit fails; the rest are 
+    // refused.
+    EXPECT_THROW(statement->modify("INSERT INTO A VALUES (1, \"a\");"),
+                 sql::Exception);
+    EXPECT_THROW(statement->modify("INSERT INTO A VALUES (2, \"b\");"),
+                 sql::Exception);
+    EXPECT_THROW(statement->modify("DELETE FROM A;"), sql::Exception);
+
+    ::setrlimit(RLIMIT_FSIZE, &saved);
+    std::signal(SIGXFSZ, handler);
+
+    std::vector<long> ids;
+    sql::ISelection *selection = statement->select("SELECT id FROM A;");
+    for (; !selection->end(); selection->next()) {
+        ids.push_back(selection->getLong(0));
+    }
+    selection->close();
+    EXPECT_EQ(std::vector<long>{1}, ids);
+
+    statement.reset();
+    conn.reset();
+    std::remove(options.walPath.c_str());
+}
+
+TEST(snapshot, loadsThenReplaysNewerEntries)
+{
+    mem::Options options;
+    options.tableShards = 3;
+    options.walPath = ::testing::TempDir() + "memstore_snapshot_test.wal";
+    options.snapshotPath = ::testing::TempDir() + "memstore_test.snapshot";
+    std::remove(options.walPath.c_str());
+    std::remove(options.snapshotPath.c_str());
+
+    auto rows = [](sql::IDBConnection* conn, const std::string& query) {
+        std::unique_ptr<sql::IStatement> statement(conn->createStatement());
+        std::multiset<std::string> result;
+        sql::ISelection *selection = statement->select(query);
+        for (; !selection->end(); selection->next()) {
+            result.insert(std::to_string(selection->getLong(0)) + 
+                          selection->getString(1));
+        }
+        selection->close();
+        return result;
+    };
+
+    std::multiset<std::string> expect;
+    {
+        std::unique_ptr<sql::IDBConnection> conn(mem::open(options));
+        std::unique_ptr<sql::IStatement> statement(conn->createStatement());
+        statement->modify("CREATE TABLE A (id INTEGER PRIMARY KEY, name TEXT);");
+        statement->modify("CREATE TABLE B (id INTEGER PRIMARY KEY, name TEXT);");
+        statement->modify("CREATE INDEX ON A(name);");
+        for (long id = 0; id < 100; ++id) 
+        {
+            statement->modify(fmt::sprintf("INSERT INTO A VALUES (%v, \"n%v\");", 
+                                           id, id % 7));
+            if (id % 10 != 3) expect.insert(fmt::sprintf("%vn%v", id, id % 7));
+        }
+        for (long id = 3; id < 100; id += 10) {
+            statement->modify(fmt::sprintf("DELETE FROM A WHERE id = %v;", id));
+        }
+        statement->modify("SNAPSHOT;");
+
+        // The log keeps only what the snapshot does not have.
+        EXPECT_EQ(0, std::ifstream(options.walPath, std::ios::ate).tellg());
+
+        // Only in the log.
+        statement->modify("INSERT INTO A VALUES (500, \"late\");");
+        statement->modify("INSERT INTO B VALUES (1, \"n1\");");
+        expect.insert("500late");
+    }
+
+    // A different number of shards than the snapshot was written with.
+    options.tableShards = 2;
+    std::unique_ptr<sql::IDBConnection> conn(mem::open(options));
+    EXPECT_EQ(expect, rows(conn.get(), "SELECT * FROM A;"));
+    EXPECT_EQ(std::multiset<std::string>({"1n1"}), 
+              rows(conn.get(), "SELECT * FROM B;"));
+
+    std::unique_ptr<sql::IStatement> statement(conn->createStatement());
+    EXPECT_THROW(statement->modify("CREATE INDEX ON A(name);"), sql::Exception);
+    EXPECT_THROW(statement->modify("INSERT INTO A VALUES (4, \"x\");"), 
+                 sql::Exception);
+    EXPECT_EQ(14u, rows(conn.get(), "SELECT A.id, B.name FROM A JOIN B "
+                                    "ON A.name = B.name;").size());
+
+    statement.reset();
+    conn.reset();
+    std::remove(options.walPath.c_str());
+    std::remove(options.snapshotPath.c_str());
+}
+
+
+// A table created while a snapshot is taken is either in the snapshot or
+// left in the log, so the rows inserted into it are there after a restart.
+TEST(snapshot, racesTableCreation)
+{
+    mem::Options options;
+    options.durability = mem::Durability::BATCH;
+    options.walPath = ::testing::TempDir() + "memstore_race_test.wal";
+    options.snapshotPath = ::testing::TempDir() + "memstore_race_test.snapshot";
+    std::remove(options.walPath.c_str());
+    std::remove(options.snapshotPath.c_str());
+
+    const int tables = 500;
+    {
+        std::unique_ptr<sql::IDBConnection> conn(mem::open(options));
+        std::atomic<bool> done{false};
+        std::thread creator([&]() 
+        {
+            std::unique_ptr<sql::IStatement> st(conn->createStatement());
+            for (int t = 0; t < tables; ++t) 
+            {
+                st->modify(fmt::sprintf("CREATE TABLE T%v (id INTEGER PRIMARY KEY, "
+                                        "name TEXT);", t));
+                st->modify(fmt::sprintf("INSERT INTO T%v VALUES (1, \"a\");", t));
+            }
+            done = true;
+        });
+
+        std::unique_ptr<sql::IStatement> statement(conn->createStatement());
+        while (!done) {
+            statement->modify("SNAPSHOT;");
+        }
+        creator.join();
+    }
+
+    std::unique_ptr<sql::IDBConnection> conn(mem::open(options));
+    std::unique_ptr<sql::IStatement> statement(conn->createStatement());
+    for (int t = 0; t < tables; ++t) 
+    {
+        sql::ISelection *selection = statement->select(
+                                        fmt::sprintf("SELECT * FROM T%v;", t));
+        EXPECT_FALSE(selection->end()) << "T" << t;
+        selection->close();
+    }
+
+    statement.reset();
+    conn.reset();
+    std::remove(options.walPath.c_str());
+    std::remove(options.snapshotPath.c_str());
+}
+
+
+TEST_F(MemstoreTest, loadCsv)
+{
+    std::string path = ::testing::TempDir() + "memstore_test.csv";
+    auto write = [&path](const std::string& text) {
+        std::ofstream(path, std::ios::binary | std::ios::trunc) << text;
+    };
+
+    std::string text = "id,name\n";
+    for (long id = 0; id < 20000; ++id) {
+        text += fmt::sprintf("%v,n%v\n", id, id % 3);
+    }
+    text += "20000,\"with, comma \"\"quoted\"\"\"\r\n20001,\n";
+    write(text);
+
+    modify("LOAD A " + path + ";");
+    insert("B", 7, "n1");
+
+    auto types = std::vector<sql::DataType>{sql::DataType::INTEGER, 
+                                            sql::DataType::TEXT};
+    auto rows = select("SELECT id, name FROM A;", types);
+    EXPECT_EQ(20002u, rows.size());
+    EXPECT_EQ("20000,with, comma \"quoted\"", rows[20000]);
+    EXPECT_EQ("20001,", rows[20001]);
+    EXPECT_EQ(6667u, select("SELECT A.id, A.name FROM A JOIN B "
+                            "ON A.name = B.name;", types).size());
+
+    // All or nothing: a key repeated in the file or already in the table.
+    write("30000,x\n30000,y\n");
+    EXPECT_THROW(modify("LOAD A " + path + ";"), sql::Exception);
+    write("30000,x\n5,y\n");
+    EXPECT_THROW(modify("LOAD A " + path + ";"), sql::Exception);
+    write("30000,x\n30001,y,z\n");
+    try 
+    {
+        modify("LOAD A " + path + ";");
+        ADD_FAILURE() << "a malformed line was loaded";
+    }
+    catch (sql::Exception& e) {
+        // Where and why, never the line itself.
+        EXPECT_EQ(path + ": line 2: too many fields", e.what());
+    }
+    EXPECT_EQ(20002u, select("SELECT id, name FROM A;", types).size());
+
+    write("30000,x\n");
+    modify("LOAD A " + path + ";");
+    EXPECT_EQ(20003u, select("SELECT id, name FROM A;", types).size());
+    EXPECT_THROW(insert("A", 30000, "again"), sql::Exception);
+
+    std::remove(path.c_str());
+}
+
+
+TEST(memory, limitRefusesInserts)
+{
+    mem::Options options;
+    options.memoryLimit = 200000;
+    std::unique_ptr<sql::IDBConnection> conn(mem::open(options));
+    std::unique_ptr<sql::IStatement> statement(conn->createStatement());
+    statement->modify("CREATE TABLE A (id INTEGER PRIMARY KEY, name TEXT);");
+
+    auto usage = [&statement]() {
+        std::map<std::string, long> bytes;
+        sql::ISelection *selection = statement->select("MEMORY;");
+        for (; !selection->end(); selection->next()) {
+            bytes[selection->getString(0)] = selection->getLong(1);
+        }
+        return bytes;
+    };
+
+    auto empty = usage();
+
+    long inserted = 0;
+    try {
+        for (; inserted < 100000; ++inserted) {
+            statement->modify(fmt::sprintf(
+                "INSERT INTO A VALUES (%v, \"a_name_too_long_to_be_kept_in_place\");", 
+                inserted));
+        }
+    }
+    catch (sql::Exception& e) {
+        EXPECT_NE(std::string::npos, std::string(e.what()).find("memory limit"));
+    }
+    EXPECT_GT(inserted, 100);
+    EXPECT_LT(inserted, 100000);
+
+    auto bytes = usage();
+    EXPECT_EQ(200000, bytes["limit"]);
+    EXPECT_GT(bytes["A.rows"], inserted * 64);
+    EXPECT_GT(bytes["A.indices"], inserted * 32);
+    EXPECT_LE(bytes["A.rows"] + bytes["A.indices"], bytes["total"]);
+    EXPECT_LE(bytes["total"], 200000);
+
+    // The old rows are freed in the background.
+    statement->modify("DELETE FROM A;");
+    bytes = usage();
+    EXPECT_EQ(0, bytes["A.rows"]);
+    EXPECT_EQ(empty["A.indices"], bytes["A.indices"]);
+    for (int i = 0; i < 100 && usage()["total"] > empty["total"]; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(empty["total"], usage()["total"]);
+    statement->modify("INSERT INTO A VALUES (1, \"again\");");
+}
+
+
+TEST(bloom, noFalseNegatives)
+{
+    BloomFilter filter(10000);
+    for (long key = 0; key < 10000; ++key) {
+        filter.insert(BloomFilter::hash(key * 7));
+    }
+    std::size_t passed = 0;
+    for (long key = 0; key < 70000; ++key) 
+    {
+        bool present = key % 7 == 0;
+        bool maybe = filter.mayContain(BloomFilter::hash(key));
+        EXPECT_TRUE(maybe || !present);
+        if (maybe && !present) ++passed;
+    }
+    EXPECT_LT(passed, 60000u / 100);
+
+    // The filter of an index grows with it and forgets nothing.
+    Table::Index<std::string> index;
+    for (long key = 0; key < 5000; ++key) {
+        index.insert(std::to_string(key), key);
+    }
+    index.remove("17", 17);
+    for (long key = 0; key < 5000; ++key) {
+        EXPECT_TRUE(index.mayContain(std::to_string(key)));
+    }
+    EXPECT_EQ(index.end(), index.find("17"));
+}
+
+
+TEST(planner, choosesByStatistics)
+{
+    using planner::JoinAlgorithm;
+
+    auto side = [](long first, long count, bool indexed) {
+        planner::JoinSide side{ColumnStats(), indexed};
+        for (long v = first; v < first + count; ++v) {
+            side.stats.add(DataObject(v));
+        }
+        return side;
+    };
+    auto plan = [](const planner::JoinSide& a, const planner::JoinSide& b) {
+        return planner::planJoin(a, b, sql::DataType::INTEGER, 0);
+    };
+
+    auto small = side(0, 100, false), big = side(0, 1000000, false);
+    EXPECT_NEAR(1000000.0, big.stats.distinctCount(), 50000.0);
+
+    EXPECT_EQ(JoinAlgorithm::HASH, plan(small, big).algorithm);
+    EXPECT_TRUE(plan(small, big).buildFirst);
+    EXPECT_FALSE(plan(big, small).buildFirst);
+
+    // Probing the index of the big table beats hashing it.
+    big.indexed = true;
+    EXPECT_EQ(JoinAlgorithm::LOOKUP_SECOND, plan(small, big).algorithm);
+    EXPECT_EQ(JoinAlgorithm::LOOKUP_FIRST, plan(big, small).algorithm);
+
+    // Two big indices sharing few keys are intersected, and so are two
+    // sharing most of them, to keep the key order.
+    EXPECT_EQ(JoinAlgorithm::INDEX_MERGE,
+              plan(big, side(990000, 1000000, true)).algorithm);
+    EXPECT_EQ(JoinAlgorithm::INDEX_MERGE,
+              plan(big, side(0, 1000000, true)).algorithm);
+
+    // When most probes find their key, descending the tree for each of
+    // them costs more than hashing.
+    auto other = side(0, 1000000, false);
+    EXPECT_EQ(JoinAlgorithm::HASH, plan(other, big).algorithm);
+
+    EXPECT_EQ(JoinAlgorithm::NESTED_LOOP, 
+              plan(side(0, 5, false), side(3, 5, false)).algorithm);
+    EXPECT_EQ(JoinAlgorithm::EMPTY, 
+              plan(side(0, 5, true), side(10, 5, true)).algorithm);
+    EXPECT_EQ(JoinAlgorithm::EMPTY, 
+              plan(side(0, 0, false), side(0, 5, false)).algorithm);
+}
+
+
+TEST(intersect, kernels)
+{
+    std::vector<std::int64_t> a, b;
+    for (std::int64_t i = -50; i < 1000; ++i) {
+        if (i % 2 == 0) a.push_back(i);
+        if (i % 3 == 0) b.push_back(i);
+    }
+
+    std::vector<std::int64_t> expect;
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(),
+                          std::back_inserter(expect));
+
+    using intersect::Kernel;
+    for (Kernel kernel : {Kernel::SCALAR, Kernel::SSE42, Kernel::AVX2}) 
+    {
+        if (!intersect::isSupported(kernel)) {
+            continue;
+        }
+        // Every length combination exercises the block tails.
+        for (std::size_t na = 0; na < 12; ++na) 
+        {
+            std::vector<std::int64_t> out(a.size());
+            std::size_t n = intersect::merge(kernel, a.data(), a.size() - na,
+                                             b.data(), b.size(), out.data());
+            out.resize(n);
+
+            std::vector<std::int64_t> want;
+            std::set_intersection(a.begin(), a.end() - na, b.begin(), b.end(),
+                                  std::back_inserter(want));
+            EXPECT_EQ(want, out);
+        }
+    }
+
+    std::vector<std::int64_t> small = {-48, -47, 0, 6, 7, 996, 2000};
+    std::vector<std::int64_t> out(small.size());
+    out.resize(intersect::gallop(small.data(), small.size(), 
+                                 a.data(), a.size(), out.data()));
+    EXPECT_EQ((std::vector<std::int64_t>{-48, 0, 6, 996}), out);
+
+    out.resize(expect.size());
+    EXPECT_EQ(expect.size(), intersectSorted(a.data(), a.size(), 
+                                             b.data(), b.size(), out.data()));
+    EXPECT_EQ(expect, out);
+}
+
+
+TEST(radix, matchesSequentialOrder)
+{
+    Schema schema;
+    schema.addColumn(ColumnInfo("id", sql::DataType::INTEGER, true));
+    schema.addColumn(ColumnInfo("name", sql::DataType::TEXT, false));
+
+    // Large enough for several partitions.
+    Table tab1(schema), tab2(schema);
+    for (long i = 0; i < 40000; ++i) {
+        tab1.insert({DataObject(i), DataObject("n" + std::to_string(i % 7001))});
+    }
+    for (long i = 0; i < 30000; ++i) {
+        tab2.insert({DataObject(i * 3), DataObject("n" + std::to_string(i % 9001))});
+    }
+    ASSERT_GT(radix::partitionBits(tab2.size()), 1u);
+
+    Table::Snapshot rows1 = tab1.snapshot(), rows2 = tab2.snapshot();
+
+    std::map<std::string, std::vector<Table::RowID>> names2;
+    for (Table::RowID id = 0; id < tab2.size(); ++id) {
+        names2[rows2[id].cast<std::string>(1)].push_back(id);
+    }
+
+    radix::RowPairs joined;
+    for (Table::RowID id = 0; id < tab1.size(); ++id) 
+    {
+        auto found = names2.find(rows1[id].cast<std::string>(1));
+        if (found == names2.end()) {
+            continue;
+        }
+        for (Table::RowID id2 : found->second) {
+            joined.emplace_back(id, id2);
+        }
+    }
+
+    std::set<long> ids1;
+    for (Table::RowID id = 0; id < tab1.size(); ++id) {
+        ids1.insert(rows1[id].cast<long>(0));
+    }
+    radix::RowPairs unpairedIds;
+    for (Table::RowID id = 0; id < tab1.size(); ++id) {
+        if (rows1[id].cast<long>(0) % 3 != 0) unpairedIds.emplace_back(id, -1);
+    }
+    for (Table::RowID id = 0; id < tab2.size(); ++id) {
+        if (!ids1.count(rows2[id].cast<long>(0))) unpairedIds.emplace_back(-1, id);
+    }
+
+    ThreadPool pool(4);
+    EXPECT_EQ(joined, radix::findEqualRows<std::string>(&rows1, &rows2, 1, 1, pool));
+    EXPECT_EQ(unpairedIds, radix::findNonPairedRows<long>(&rows1, &rows2, 0, 0, pool));
+
+    ThreadPool inline_(1);
+    EXPECT_EQ(joined, radix::findEqualRows<std::string>(&rows1, &rows2, 1, 1, inline_));
+}
+
+
+TEST_F(MemstoreTest, intersectionOnOutOfOrderKeys)
+{
+    for (long id : {5, 1, 9, 3, 7}) insert("A", id, "a");
+    for (long id : {2, 3, 9, 4, 5}) insert("B", id, "b");
+
+    EXPECT_EQ((std::vector<std::string>{"3,a,3,b", "5,a,5,b", "9,a,9,b"}),
+              select("SELECT * FROM A JOIN B ON A.id = B.id;", joinTypes));
+}
+
+
+// Past the sizes where a hash join would be cheaper, the keys still come
+// out in order.
+TEST_F(MemstoreTest, intersectionOfBigTablesIsInKeyOrder)
+{
+    const long rows = 20000;
+    std::vector<long> ids(rows);
+    for (long i = 0; i < rows; ++i) ids[i] = i;
+    std::mt19937 random(7);
+    std::shuffle(ids.begin(), ids.end(), random);
+    for (long id : ids) insert("A", id, "a");
+    std::shuffle(ids.begin(), ids.end(), random);
+    for (long id : ids) insert("B", id + rows / 2, "b");
+
+    std::vector<std::string> result = select(
+            "SELECT A.id FROM A JOIN B ON A.id = B.id;", {sql::DataType::INTEGER});
+    ASSERT_EQ(std::size_t(rows / 2), result.size());
+    for (long i = 0; i < rows / 2; ++i) {
+        ASSERT_EQ(std::to_string(rows / 2 + i), result[i]);
+    }
+}
+
+
+TEST_F(MemstoreTest, openSelectionDoesNotBlockWriters)
+{
+    fillNames();
+    std::unique_ptr<sql::IStatement> writer(m_conn->createStatement());
+
+    sql::ISelection *rows = m_statement->select("SELECT id FROM A;");
+    writer->modify("INSERT INTO A VALUES (4, \"w\");");
+    writer->modify("DELETE FROM A;");
+
+    // The selection keeps reading the rows it started with.
+    std::vector<long> ids;
+    for (; !rows->end(); rows->next()) {
+        ids.push_back(rows->getLong(0));
+    }
+    rows->close();
+    EXPECT_EQ((std::vector<long>{1, 2, 3}), ids);
+
+    // Enough rows to span several segments of the row store.
+    for (long id = 1000; id < 6000; ++id) insert("B", id, std::to_string(id));
+    rows = m_statement->select("SELECT * FROM A JOIN B ON A.name = B.name;");
+    writer->modify("INSERT INTO A VALUES (4999, \"4999\");");
+    EXPECT_TRUE(rows->end());
+    rows->close();
+
+    EXPECT_EQ(std::vector<std::string>{"4999,4999,4999,4999"}, 
+              select(innerJoinOnName, joinTypes));
+}
+
+
+// A statement serves query after query, as it does for a connection, and
+// makes its selections in the memory it was given: released after each
+// query, a small buffer is enough for any number of them.
+TEST_F(MemstoreTest, statementIsReusedInItsMemory)
+{
+    fillNames();
+
+    alignas(std::max_align_t) char buffer[16 * 1024];
+    std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer),
+                                              std::pmr::null_memory_resource());
+    std::unique_ptr<sql::IStatement> statement(m_conn->createStatement(&arena));
+
+    for (int i = 0; i < 200; ++i)
+    {
+        for (const char* query : {"SELECT * FROM A;", "MEMORY;",
+                                  "SELECT * FROM A JOIN B ON A.name = B.name;"})
+        {
+            sql::ISelection *selection = statement->select(query);
+            EXPECT_FALSE(selection->end());
+            sql::ColumnBatch batch(sql::ColumnBatch::DEFAULT_CAPACITY, &arena);
+            EXPECT_NE(0u, selection->nextBatch(batch));
+            selection->close();
+            statement->close();
+        }
+        statement->close();
+        arena.release();
+    }
+}
+
+
+// Writers inserting at the same time have their rows applied together;
+// each row still succeeds or fails on its own.
+TEST_F(MemstoreTest, concurrentInsertsFailAlone)
+{
+    const int writers = 8;
+    const long keys = 1000;
+    std::atomic<long> inserted{0}, refused{0};
+
+    std::vector<std::thread> threads;
+    for (int w = 0; w < writers; ++w) 
+    {
+        threads.emplace_back([&]() 
+        {
+            std::unique_ptr<sql::IStatement> st(m_conn->createStatement());
+            for (long id = 0; id < keys; ++id) 
+            {
+                try 
+                {
+                    st->modify(fmt::sprintf("INSERT INTO A VALUES (%v, \"a\");", 
+                                            id));
+                    ++inserted;
+                }
+                catch (sql::Exception&) {
+                    ++refused;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    EXPECT_EQ(keys, inserted.load());
+    EXPECT_EQ(keys * (writers - 1), refused.load());
+    EXPECT_EQ(std::size_t(keys), 
+              select("SELECT id FROM A;", {sql::DataType::INTEGER}).size());
+}
+
+
+int main(int argc, char *argv[])
+{
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -35,13 +35,21 @@ ColumnInfo parseColumn(const std::string& s)
     sql::DataType type = parseType(tmp);
 
     bool primaryKey = false;
-    if (ss >> tmp && toUpper(tmp) == "PRIMARY" && 
-        ss >> tmp && toUpper(tmp) == "KEY")
+    bool dictionary = false;
+    while (ss >> tmp)
     {
-        primaryKey = true;
+        if (toUpper(tmp) == "PRIMARY" && ss >> tmp && toUpper(tmp) == "KEY") {
+            primaryKey = true;
+        }
+        else if (toUpper(tmp) == "DICTIONARY") {
+            dictionary = true;
+        }
+    }
+    if (dictionary && type != sql::DataType::TEXT) {
+        throw sql::Exception("only TEXT columns can be DICTIONARY: " + name);
     }
 
-    return ColumnInfo(name, type, primaryKey);
+    return ColumnInfo(name, type, primaryKey, dictionary);
 }
 
 
@@ -0,0 +1,305 @@
+#ifndef RADIX_JOIN_H
+#define RADIX_JOIN_H
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "table.h"
+#include "thread_pool.h"
+
+// Hash tables built over a TEXT column refer to the strings stored in the 
+// table instead of copying them.
+template<typename T> struct HashKey { using type = T; };
+template<> struct HashKey<std::string> { using type = std::string_view; };
+
+
+// Parallel joins: both inputs are split by key hash into partitions small 
+// enough to stay in cache, then the partitions are joined independently 
+// on the thread pool. Per-partition results are put back into the order 
+// the single-threaded joins produce.
+namespace radix
+{
+using RowPairs = std::vector<std::pair<Table::RowID, Table::RowID>>;
+
+// Joins below this total size are not worth the partitioning pass.
+const std::size_t MIN_ROWS = 1 << 17;
+
+// Build side rows per partition.
+const std::size_t PARTITION_ROWS = 1 << 13;
+const std::size_t MAX_PARTITION_BITS = 12;
+
+
+inline std::size_t partitionBits(std::size_t rows)
+{
+    std::size_t bits = 0;
+    while ((std::size_t(1) << bits) * PARTITION_ROWS < rows && 
+           bits < MAX_PARTITION_BITS) 
+    {
+        ++bits;
+    }
+    return bits;
+}
+
+
+template<typename T>
+std::size_t partitionOf(const T& value, std::size_t bits)
+{
+    using Key = typename HashKey<T>::type;
+    if (bits == 0) {
+        return 0;
+    }
+    // std::hash may be the identity, so mix before taking the high bits.
+    std::uint64_t h = std::hash<Key>()(Key(value));
+    h *= 0x9E3779B97F4A7C15ull;
+    return h >> (64 - bits);
+}
+
+
+// Row ids grouped by partition; row order is kept within a partition.
+struct Partitions
+{
+    std::vector<Table::RowID> rows;
+    std::vector<std::size_t>  offsets;
+
+    std::size_t size(std::size_t p) const { 
+        return offsets[p + 1] - offsets[p]; 
+    }
+    const Table::RowID* begin(std::size_t p) const { 
+        return rows.data() + offsets[p]; 
+    }
+    const Table::RowID* end(std::size_t p) const { 
+        return rows.data() + offsets[p + 1]; 
+    }
+};
+
+
+// Two passes over contiguous chunks of the table: a histogram of 
+// partitions per chunk, then a scatter into the ranges reserved for it.
+template<typename T>
+Partitions partition(const Table::Snapshot* table, std::size_t col, 
+                     std::size_t bits, ThreadPool& pool)
+{
+    const std::size_t partitions = std::size_t(1) << bits;
+    const std::size_t none = partitions;
+    const std::size_t rows = table->size();
+    const std::size_t chunks = pool.size();
+    const std::size_t chunkSize = (rows + chunks - 1) / chunks;
+
+    std::vector<std::uint32_t> partitionIds(rows);
+    std::vector<std::vector<std::size_t>> histograms(
+                        chunks, std::vector<std::size_t>(partitions, 0));
+
+    pool.parallelFor(chunks, [&](std::size_t chunk) 
+    {
+        std::size_t begin = chunk * chunkSize;
+        std::size_t end = std::min(rows, begin + chunkSize);
+        for (Table::RowID id = begin; id < end; ++id) 
+        {
+            auto row = (*table)[id];
+            if (row.isNull(col)) {
+                partitionIds[id] = none;
+                continue;
+            }
+            std::size_t p = partitionOf(row.template cast<T>(col), bits);
+            partitionIds[id] = p;
+            ++histograms[chunk][p];
+        }
+    });
+
+    Partitions result;
+    result.offsets.resize(partitions + 1);
+
+    std::size_t total = 0;
+    for (std::size_t p = 0; p < partitions; ++p) 
+    {
+        result.offsets[p] = total;
+        for (std::size_t chunk = 0; chunk < chunks; ++chunk) 
+        {
+            std::size_t count = histograms[chunk][p];
+            histograms[chunk][p] = total;
+            total += count;
+        }
+    }
+    result.offsets[partitions] = total;
+    result.rows.resize(total);
+
+    pool.parallelFor(chunks, [&](std::size_t chunk) 
+    {
+        std::vector<std::size_t>& cursor = histograms[chunk];
+        std::size_t begin = chunk * chunkSize;
+        std::size_t end = std::min(rows, begin + chunkSize);
+        for (Table::RowID id = begin; id < end; ++id) {
+            if (partitionIds[id] != none) {
+                result.rows[cursor[partitionIds[id]]++] = id;
+            }
+        }
+    });
+
+    return result;
+}
+
+
+template<typename T>
+RowPairs joinPartition(const Table::Snapshot* tab1, 
+                       const Table::Snapshot* tab2,
+                       std::size_t col1, std::size_t col2,
+                       const Partitions& parts1, const Partitions& parts2,
+                       std::size_t p)
+{
+    using Key = typename HashKey<T>::type;
+    const std::size_t none = -1;
+
+    bool buildFirst = parts1.size(p) < parts2.size(p);
+
+    const Table::Snapshot *build = buildFirst ? tab1 : tab2;
+    const Table::Snapshot *probe = buildFirst ? tab2 : tab1;
+    std::size_t buildCol = buildFirst ? col1 : col2;
+    std::size_t probeCol = buildFirst ? col2 : col1;
+    const Partitions& buildParts = buildFirst ? parts1 : parts2;
+    const Partitions& probeParts = buildFirst ? parts2 : parts1;
+
+    const Table::RowID *buildRows = buildParts.begin(p);
+    std::size_t buildSize = buildParts.size(p);
+
+    // Chains hold positions within the partition, in row order.
+    std::unordered_map<Key, std::size_t> heads;
+    std::vector<std::size_t> next(buildSize, none);
+    heads.reserve(buildSize);
+
+    for (std::size_t i = buildSize; i-- > 0; ) 
+    {
+        Key key((*build)[buildRows[i]].template cast<T>(buildCol));
+        auto result = heads.emplace(key, i);
+        if (!result.second) {
+            next[i] = result.first->second;
+            result.first->second = i;
+        }
+    }
+
+    RowPairs rowPairs;
+    for (const Table::RowID* id = probeParts.begin(p); 
+         id != probeParts.end(p); ++id) 
+    {
+        Key key((*probe)[*id].template cast<T>(probeCol));
+        auto found = heads.find(key);
+        if (found == heads.end()) {
+            continue;
+        }
+        for (std::size_t i = found->second; i != none; i = next[i]) 
+        {
+            if (buildFirst) {
+                rowPairs.emplace_back(buildRows[i], *id);
+            } 
+            else {
+                rowPairs.emplace_back(*id, buildRows[i]);
+            }
+        }
+    }
+    return rowPairs;
+}
+
+
+// Same contract as findEqualRowsByHash: pairs ordered by the row of the 
+// first table, then by the row of the second one.
+template<typename T>
+RowPairs findEqualRows(const Table::Snapshot* tab1, 
+                       const Table::Snapshot* tab2,
+                       std::size_t col1, std::size_t col2, ThreadPool& pool)
+{
+    std::size_t bits = partitionBits(std::min(tab1->size(), tab2->size()));
+
+    Partitions parts1 = partition<T>(tab1, col1, bits, pool);
+    Partitions parts2 = partition<T>(tab2, col2, bits, pool);
+
+    std::size_t partitions = std::size_t(1) << bits;
+    std::vector<RowPairs> results(partitions);
+    pool.parallelFor(partitions, [&](std::size_t p) {
+        results[p] = joinPartition<T>(tab1, tab2, col1, col2, 
+                                      parts1, parts2, p);
+    });
+
+    // Equal keys share a partition, so every row of tab1 has all its 
+    // pairs, already ordered, in one partition. A counting pass over 
+    // the first row id restores the global order.
+    std::vector<std::size_t> start(tab1->size() + 1, 0);
+    for (const RowPairs& result : results) {
+        for (const auto& pair : result) {
+            ++start[pair.first + 1];
+        }
+    }
+    for (std::size_t i = 1; i < start.size(); ++i) {
+        start[i] += start[i - 1];
+    }
+
+    RowPairs rowPairs(start.back());
+    for (const RowPairs& result : results) {
+        for (const auto& pair : result) {
+            rowPairs[start[pair.first]++] = pair;
+        }
+    }
+    return rowPairs;
+}
+
+
+// Same contract as findNonPairedRowsByHash: unpaired rows of the first 
+// table in row order, then those of the second one.
+template<typename T>
+RowPairs findNonPairedRows(const Table::Snapshot* tab1, 
+                           const Table::Snapshot* tab2,
+                           std::size_t col1, std::size_t col2, 
+                           ThreadPool& pool)
+{
+    using Key = typename HashKey<T>::type;
+
+    std::size_t bits = partitionBits(std::max(tab1->size(), tab2->size()));
+
+    Partitions parts1 = partition<T>(tab1, col1, bits, pool);
+    Partitions parts2 = partition<T>(tab2, col2, bits, pool);
+
+    // Partitions own disjoint rows, so they can flag them without locking.
+    std::vector<char> unpaired1(tab1->size(), 0);
+    std::vector<char> unpaired2(tab2->size(), 0);
+
+    auto flag = [](const Table::Snapshot* tab, std::size_t col, 
+                   const Partitions& parts,
+                   const std::unordered_set<Key>& other, 
+                   std::vector<char>& unpaired, std::size_t p)
+    {
+        for (const Table::RowID* id = parts.begin(p); id != parts.end(p); ++id) {
+            if (other.find(Key((*tab)[*id].template cast<T>(col))) == other.end()) {
+                unpaired[*id] = 1;
+            }
+        }
+    };
+
+    auto keys = [](const Table::Snapshot* tab, std::size_t col, 
+                   const Partitions& parts, std::size_t p)
+    {
+        std::unordered_set<Key> keys;
+        keys.reserve(parts.size(p));
+        for (const Table::RowID* id = parts.begin(p); id != parts.end(p); ++id) {
+            keys.insert(Key((*tab)[*id].template cast<T>(col)));
+        }
+        return keys;
+    };
+
+    pool.parallelFor(std::size_t(1) << bits, [&](std::size_t p) {
+        flag(tab1, col1, parts1, keys(tab2, col2, parts2, p), unpaired1, p);
+        flag(tab2, col2, parts2, keys(tab1, col1, parts1, p), unpaired2, p);
+    });
+
+    RowPairs ids;
+    for (Table::RowID id = 0; id < unpaired1.size(); ++id) {
+        if (unpaired1[id]) ids.emplace_back(id, std::size_t(-1));
+    }
+    for (Table::RowID id = 0; id < unpaired2.size(); ++id) {
+        if (unpaired2[id]) ids.emplace_back(std::size_t(-1), id);
+    }
+    return ids;
+}
+
+} // namespace radix
+
+#endif // RADIX_JOIN_H
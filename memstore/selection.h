@@ -1,166 +1,375 @@
 #ifndef SELECTION_H
 #define SELECTION_H
 
+#include <memory>
+#include <memory_resource>
+
 #include "memstore.h"
 #include "table.h"
+#include "memory.h"
 
-class ITableLocker
+// A selection made in the memory of the statement that reads it, and
+// given back to that memory when the statement moves on.
+class SelectionDeleter
 {
+    using Destroy = void (*)(sql::ISelection*, std::pmr::memory_resource*);
+
+    std::pmr::memory_resource *m_memory = nullptr;
+    Destroy                    m_destroy = nullptr;
+
 public:
-    virtual void unlock_shared(const std::string& tableName) = 0;
-    virtual ~ITableLocker() {}
+    SelectionDeleter() = default;
+    SelectionDeleter(std::pmr::memory_resource* memory, Destroy destroy)
+        : m_memory(memory), m_destroy(destroy) {}
+
+    void operator()(sql::ISelection* selection) const { 
+        m_destroy(selection, m_memory); 
+    }
 };
 
-class FullTableSelection : public sql::ISelection
+using SelectionPtr = std::unique_ptr<sql::ISelection, SelectionDeleter>;
+
+template<typename T, typename... Args>
+SelectionPtr makeSelection(std::pmr::memory_resource* memory, Args&&... args)
 {
-    ITableLocker    *m_storage;
-    std::string      m_tableName;
-    Table::iterator  m_currentRow;
-    Table::iterator  m_end;
-public:
-    FullTableSelection(ITableLocker* storage,
-                       std::string tableName,
-                       const Table::iterator& begin, 
-                       const Table::iterator& end)
-        : m_storage(storage), m_tableName(tableName), 
-          m_currentRow(begin), m_end(end) 
+    void* place = memory->allocate(sizeof(T), alignof(T));
+    T* selection;
+    try {
+        selection = new (place) T(std::forward<Args>(args)...);
+    }
+    catch (...) 
     {
+        memory->deallocate(place, sizeof(T), alignof(T));
+        throw;
     }
 
-    FullTableSelection(const FullTableSelection&) = delete;
-    FullTableSelection(FullTableSelection&& other) 
-        : m_storage(other.m_storage), m_tableName(other.m_tableName),
-          m_currentRow(other.m_currentRow), m_end(other.m_end)
+    auto destroy = [](sql::ISelection* base, std::pmr::memory_resource* memory) 
     {
-        other.m_storage = nullptr;
-    }
+        T* selection = static_cast<T*>(base);
+        selection->~T();
+        memory->deallocate(selection, sizeof(T), alignof(T));
+    };
+    return SelectionPtr(selection, SelectionDeleter(memory, destroy));
+}
+
+
+// Rows of a table as of the moment the selection was made. No lock is
+// held, so inserts into the table go ahead while the selection is read.
+class FullTableSelection : public sql::ISelection
+{
+    Table::Snapshot  m_snapshot;
+    Table::RowID     m_currentRow;
 
-    ~FullTableSelection() { close(); }
+    // Table column of each selected column, empty when all are selected.
+    std::pmr::vector<std::size_t> m_columns;
 
-    FullTableSelection& operator= (const FullTableSelection&) = delete;
-    FullTableSelection& operator= (FullTableSelection&& rhs)
+    // Rows of the last batch, kept for its storage.
+    std::pmr::vector<Table::RowID> m_batchRows;
+
+public:
+    FullTableSelection(Table::Snapshot&& snapshot,
+                       std::pmr::vector<std::size_t>&& columns = {},
+                       std::pmr::memory_resource* memory = 
+                            std::pmr::get_default_resource())
+        : m_snapshot(std::move(snapshot)), m_currentRow(-1), 
+          m_columns(std::move(columns)), m_batchRows(memory)
     {
-        m_storage = rhs.m_storage;
-        m_tableName = rhs.m_tableName;
-        m_currentRow = rhs.m_currentRow;
-        m_end = rhs.m_end;
-        rhs.m_storage = nullptr;
-        return *this;
+        next();
+    }
+
+    // Skips the rows removed before the snapshot was taken.
+    void next() override 
+    { 
+        do {
+            ++m_currentRow;
+        } while (m_currentRow < m_snapshot.size() && 
+                 m_snapshot.isRemoved(m_currentRow));
     }
 
-    void next() override { ++m_currentRow; }
-    bool end()  override { return m_currentRow == m_end; }
+    bool end()  override { return m_currentRow >= m_snapshot.size(); }
     
     bool isNull(std::size_t columnIndex) override {
-        return (*m_currentRow).isNull(columnIndex);
+        return m_snapshot.isNull(m_currentRow, column(columnIndex));
     }
 
     long getLong(std::size_t columnIndex) override {
-        return (*m_currentRow).getLong(columnIndex);
+        return m_snapshot.getLong(m_currentRow, column(columnIndex));
     }
 
     std::string getString(std::size_t columnIndex) override {
-        return (*m_currentRow).getString(columnIndex);
+        return m_snapshot.getString(m_currentRow, column(columnIndex));
     }
 
-    void close() override 
-    { 
-        if (m_storage) {
-            m_storage->unlock_shared(m_tableName);
-            m_storage = nullptr;
+    std::size_t nextBatch(sql::ColumnBatch& batch) override
+    {
+        m_batchRows.clear();
+        for (; !end() && m_batchRows.size() < batch.capacity(); next()) {
+            m_batchRows.push_back(m_currentRow);
         }
+        if (m_batchRows.empty()) 
+        {
+            batch.reset(0, 0);
+            return 0;
+        }
+
+        const Schema& schema = m_snapshot.schema();
+        std::size_t columns = m_columns.empty() ? schema.size() 
+                                                : m_columns.size();
+        batch.reset(columns, m_batchRows.size());
+
+        // Removed rows were skipped above, so the cells are read as is.
+        for (std::size_t i = 0; i < m_batchRows.size(); ++i) 
+        {
+            auto row = m_snapshot[m_batchRows[i]];
+            for (std::size_t c = 0; c < columns; ++c) 
+            {
+                std::size_t col = column(c);
+                if (row.isNull(col)) {
+                    batch.setNull(c, i);
+                }
+                else if (schema.typeOf(col) == sql::DataType::INTEGER) {
+                    batch.setLong(c, i, row.getLong(col));
+                }
+                else {
+                    batch.setString(c, i, row.getString(col));
+                }
+            }
+        }
+        return m_batchRows.size();
+    }
+
+    void close() override { m_snapshot = Table::Snapshot(); }
+
+private:
+    std::size_t column(std::size_t columnIndex) const {
+        return m_columns.empty() ? columnIndex : m_columns[columnIndex];
     }
 };
 
 
 
-class Selection : public sql::ISelection
+// Records computed up front, such as a report.
+class RecordSelection : public sql::ISelection
 {
-public:
-    struct Info;
-
-private:
     std::vector<Record> m_records;
-    std::size_t         m_currentRecordIndex;
+    std::size_t         m_current;
 
 public:
-    Selection(const Info& selectionInfo);
+    explicit RecordSelection(std::vector<Record>&& records)
+        : m_records(std::move(records)), m_current(0) {}
 
-    void next() override;
+    void next() override { ++m_current; }
+    bool end()  override { return m_current >= m_records.size(); }
 
-    bool end()  override { 
-        return m_currentRecordIndex == std::size_t(-1); 
-    }
-    
     bool isNull(std::size_t columnIndex) override {
-        return m_records[m_currentRecordIndex][columnIndex].isNull();
+        return m_records[m_current][columnIndex].isNull();
     }
 
     long getLong(std::size_t columnIndex) override {
-        return m_records[m_currentRecordIndex][columnIndex].getLong();
+        return m_records[m_current][columnIndex].getLong();
     }
 
     std::string getString(std::size_t columnIndex) override {
-        return m_records[m_currentRecordIndex][columnIndex].getString();
+        return m_records[m_current][columnIndex].getString();
     }
 
-    void close() override {}
+    std::size_t nextBatch(sql::ColumnBatch& batch) override
+    {
+        std::size_t first = std::min(m_current, m_records.size());
+        std::size_t rows = std::min(batch.capacity(), 
+                                    m_records.size() - first);
+        batch.reset(rows ? m_records[first].size() : 0, rows);
 
+        for (std::size_t i = 0; i < rows; ++i) 
+        {
+            const Record& record = m_records[first + i];
+            for (std::size_t c = 0; c < record.size(); ++c) 
+            {
+                if (record[c].isNull()) {
+                    batch.setNull(c, i);
+                }
+                else if (record[c].type() == sql::DataType::INTEGER) {
+                    batch.setLong(c, i, record[c].getLong());
+                }
+                else {
+                    batch.setString(c, i, record[c].getString());
+                }
+            }
+        }
+        m_current = first + rows;
+        return rows;
+    }
+
+    void close() override { m_records.clear(); }
+};
+
+
+
+// Rows of a join. Only the matched row ids are kept; cells are read from 
+// snapshots of the tables as the caller iterates, so no table stays 
+// locked while the selection is open.
+class Selection : public sql::ISelection
+{
 public:
     struct Info 
     {
         struct Column 
         {
-            std::string    name;
             sql::DataType  type;
             std::size_t    tableIndex;
             std::size_t    tableColumnIndex;
         };
 
-        std::vector<Column> columns;
-        std::vector<Table*> tables;
-        std::vector<std::vector<Table::RowID>> rows;
+        // All taken from the memory of the statement.
+        std::pmr::vector<Column> columns;
+        std::pmr::vector<Table::Snapshot> tables;
+        std::pmr::vector<std::pmr::vector<Table::RowID>> rows;
+
+        // The bytes of rows, charged while the selection is open.
+        memory::Charge memory;
+
+        explicit Info(std::pmr::memory_resource* resource = 
+                            std::pmr::get_default_resource())
+            : columns(resource), tables(resource), rows(resource) {}
     };
-};
 
+private:
+    Info         m_info;
+    std::size_t  m_rowCount;
+    std::size_t  m_currentRecordIndex;
 
-Selection::Selection(const Info& selectionInfo) : m_currentRecordIndex(-1)
-{
-    std::vector<std::vector<Record>> tableRecordMatrix;
+public:
+    explicit Selection(Info&& selectionInfo);
+    ~Selection() { close(); }
 
-    for (std::size_t i = 0; i < selectionInfo.tables.size(); ++i) 
-    {
-        Table *table = selectionInfo.tables[i];
-        const std::vector<Table::RowID> &rowIds = selectionInfo.rows[i];
-        std::vector<Record> tableRecords = table->select(rowIds);
-        tableRecordMatrix.push_back(std::move(tableRecords));
-    }
+    Selection(const Selection&) = delete;
+    Selection& operator= (const Selection&) = delete;
 
-    std::size_t rowCount = tableRecordMatrix[0].size();
-    m_records.resize(rowCount);
-    std::size_t table, col;
-    for (std::size_t row = 0; row < rowCount; ++row) 
-    {
-        m_records[row].reserve(selectionInfo.columns.size());
-        for (const Info::Column& column : selectionInfo.columns) 
-        {
-            table = column.tableIndex;
-            col   = column.tableColumnIndex;
-            m_records[row].push_back(tableRecordMatrix[table][row][col]);
-        }
+    void next() override;
+
+    bool end()  override { 
+        return m_currentRecordIndex == std::size_t(-1); 
     }
+    
+    bool isNull(std::size_t columnIndex) override;
+    long getLong(std::size_t columnIndex) override;
+    std::string getString(std::size_t columnIndex) override;
+
+    // Column by column: each one reads a single table by its row ids.
+    std::size_t nextBatch(sql::ColumnBatch& batch) override;
 
-    if (!m_records.empty()) {
-        m_currentRecordIndex = 0;
+    void close() override 
+    { 
+        m_info.tables.clear(); 
+        m_info.rows.clear();
+        m_info.memory = memory::Charge();
+        m_currentRecordIndex = -1;
     }
+
+private:
+    // The table and row behind a column of the current record, or nullptr 
+    // if that side of the join has no row.
+    const Table::Snapshot* locate(std::size_t columnIndex, Table::RowID& row,
+                                  std::size_t& tableColumn) const;
+};
+
+
+Selection::Selection(Info&& selectionInfo) 
+    : m_info(std::move(selectionInfo)), 
+      m_rowCount(m_info.rows.empty() ? 0 : m_info.rows[0].size()),
+      m_currentRecordIndex(m_rowCount ? 0 : -1)
+{
 }
 
 
 void Selection::next()
 {
-    if (++m_currentRecordIndex == m_records.size()) {
+    if (++m_currentRecordIndex == m_rowCount) {
         m_currentRecordIndex = -1;
     }
 }
 
-#endif // SELECTION_H
\ No newline at end of file
+
+const Table::Snapshot* Selection::locate(std::size_t columnIndex, 
+                                         Table::RowID& row,
+                                         std::size_t& tableColumn) const
+{
+    const Info::Column& column = m_info.columns[columnIndex];
+    row = m_info.rows[column.tableIndex][m_currentRecordIndex];
+    tableColumn = column.tableColumnIndex;
+    if (row == std::size_t(-1)) {
+        return nullptr;
+    }
+    return &m_info.tables[column.tableIndex];
+}
+
+
+bool Selection::isNull(std::size_t columnIndex)
+{
+    Table::RowID row;
+    std::size_t col;
+    const Table::Snapshot *table = locate(columnIndex, row, col);
+    return table == nullptr || table->isNull(row, col);
+}
+
+
+long Selection::getLong(std::size_t columnIndex)
+{
+    Table::RowID row;
+    std::size_t col;
+    return locate(columnIndex, row, col)->getLong(row, col);
+}
+
+
+std::string Selection::getString(std::size_t columnIndex)
+{
+    Table::RowID row;
+    std::size_t col;
+    return locate(columnIndex, row, col)->getString(row, col);
+}
+
+std::size_t Selection::nextBatch(sql::ColumnBatch& batch)
+{
+    if (end()) 
+    {
+        batch.reset(0, 0);
+        return 0;
+    }
+
+    std::size_t first = m_currentRecordIndex;
+    std::size_t rows = std::min(batch.capacity(), m_rowCount - first);
+    batch.reset(m_info.columns.size(), rows);
+
+    for (std::size_t c = 0; c < m_info.columns.size(); ++c) 
+    {
+        const Info::Column& column = m_info.columns[c];
+        const Table::Snapshot& table = m_info.tables[column.tableIndex];
+        const Table::RowID* ids = m_info.rows[column.tableIndex].data() + first;
+        std::size_t col = column.tableColumnIndex;
+
+        for (std::size_t i = 0; i < rows; ++i) 
+        {
+            if (ids[i] == Table::RowID(-1)) 
+            {
+                batch.setNull(c, i);
+                continue;
+            }
+            auto row = table[ids[i]];
+            if (row.isNull(col)) {
+                batch.setNull(c, i);
+            }
+            else if (column.type == sql::DataType::INTEGER) {
+                batch.setLong(c, i, row.getLong(col));
+            }
+            else {
+                batch.setString(c, i, row.getString(col));
+            }
+        }
+    }
+
+    m_currentRecordIndex = first + rows == m_rowCount ? std::size_t(-1) 
+                                                      : first + rows;
+    return rows;
+}
+
+#endif // SELECTION_H
@@ -0,0 +1,293 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "codec.h"
+#include "snapshot_file.h"
+
+using namespace codec;
+
+namespace
+{
+const char MAGIC[] = "MEMSNAP1";
+const std::size_t MAGIC_SIZE = sizeof(MAGIC) - 1;
+
+
+std::string failure(const std::string& what, const std::string& path) {
+    return fmt::sprintf("cannot %v snapshot %v: %v", what, path,
+                        std::strerror(errno));
+}
+
+
+// Buffers the encoded data and writes it out in large pieces.
+class Output
+{
+    static const std::size_t FLUSH_SIZE = 1 << 20;
+
+    std::string m_path;
+    int         m_fd;
+    std::string m_buffer;
+
+public:
+    explicit Output(const std::string& path)
+        : m_path(path),
+          m_fd(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                      0644))
+    {
+        if (m_fd < 0) {
+            throw sql::Exception(failure("create", m_path));
+        }
+    }
+
+    ~Output() { if (m_fd >= 0) ::close(m_fd); }
+
+    std::string& buffer() { return m_buffer; }
+
+    void flushIfFull() {
+        if (m_buffer.size() >= FLUSH_SIZE) flush();
+    }
+
+    void flush()
+    {
+        const char* p = m_buffer.data();
+        std::size_t left = m_buffer.size();
+        while (left > 0)
+        {
+            ssize_t n = ::write(m_fd, p, left);
+            if (n < 0)
+            {
+                if (errno == EINTR) continue;
+                throw sql::Exception(failure("write", m_path));
+            }
+            p += n;
+            left -= n;
+        }
+        m_buffer.clear();
+    }
+
+    void close()
+    {
+        flush();
+        if (::fdatasync(m_fd) != 0 || ::close(m_fd) != 0)
+        {
+            m_fd = -1;
+            throw sql::Exception(failure("write", m_path));
+        }
+        m_fd = -1;
+    }
+};
+
+
+void writeTable(Output& out, const snapshot_file::Source& source)
+{
+    const Table::Snapshot& rows = source.rows;
+    std::string& buf = out.buffer();
+
+    std::vector<Table::RowID> live;
+    live.reserve(rows.size());
+    for (Table::RowID id = 0; id < rows.size(); ++id) {
+        if (!rows.isRemoved(id)) live.push_back(id);
+    }
+
+    putString(buf, source.name);
+    putSchema(buf, source.schema);
+    putU64(buf, source.lsn);
+    putU64(buf, live.size());
+
+    for (std::size_t col = 0; col < source.schema.size(); ++col)
+    {
+        for (Table::RowID id : live)
+        {
+            putU8(buf, rows.isNull(id, col));
+            out.flushIfFull();
+        }
+
+        if (source.schema.typeOf(col) == sql::DataType::INTEGER)
+        {
+            for (Table::RowID id : live)
+            {
+                putU64(buf, rows.isNull(id, col) ? 0 : rows.getLong(id, col));
+                out.flushIfFull();
+            }
+            continue;
+        }
+
+        std::uint64_t offset = 0;
+        putU64(buf, offset);
+        for (Table::RowID id : live)
+        {
+            if (!rows.isNull(id, col)) offset += rows.getString(id, col).size();
+            putU64(buf, offset);
+            out.flushIfFull();
+        }
+        for (Table::RowID id : live)
+        {
+            if (!rows.isNull(id, col)) buf.append(rows.getString(id, col));
+            out.flushIfFull();
+        }
+    }
+
+    putU32(buf, source.indexed.size());
+    for (std::size_t col : source.indexed)
+    {
+        // Positions among the live rows, ordered by key and then by row.
+        std::vector<std::size_t> order;
+        for (std::size_t i = 0; i < live.size(); ++i) {
+            if (!rows.isNull(live[i], col)) order.push_back(i);
+        }
+
+        if (source.schema.typeOf(col) == sql::DataType::INTEGER) {
+            std::stable_sort(order.begin(), order.end(),
+                [&](std::size_t a, std::size_t b) {
+                    return rows.getLong(live[a], col) < rows.getLong(live[b], col);
+                });
+        }
+        else {
+            std::stable_sort(order.begin(), order.end(),
+                [&](std::size_t a, std::size_t b) {
+                    return rows.getString(live[a], col) <
+                           rows.getString(live[b], col);
+                });
+        }
+
+        putU32(buf, col);
+        putU64(buf, order.size());
+        for (std::size_t i : order)
+        {
+            putU64(buf, i);
+            out.flushIfFull();
+        }
+    }
+}
+
+} // namespace
+
+
+void snapshot_file::write(const std::string& path,
+                          const std::vector<Source>& tables)
+{
+    std::string temporary = path + ".tmp";
+    {
+        Output out(temporary);
+        out.buffer().append(MAGIC, MAGIC_SIZE);
+        putU32(out.buffer(), tables.size());
+        for (const Source& table : tables) {
+            writeTable(out, table);
+        }
+        out.close();
+    }
+
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        throw sql::Exception(failure("replace", path));
+    }
+    // Only then may the log entries the snapshot holds go.
+    syncDirectoryOf(path);
+}
+
+
+snapshot_file::File::File(const std::string& path)
+{
+    if (::access(path.c_str(), F_OK) != 0 && errno == ENOENT) {
+        return;
+    }
+    m_file = std::make_unique<MappedFile>(path);
+
+    Reader reader(m_file->data(), m_file->size());
+    if (reader.left() < MAGIC_SIZE || 
+        std::string(reader.take(MAGIC_SIZE), MAGIC_SIZE) != MAGIC) 
+    {
+        throw sql::Exception(path + " is not a snapshot");
+    }
+
+    for (std::uint32_t n = reader.u32(); n > 0; --n)
+    {
+        Table table;
+        table.name = reader.string();
+        table.schema = reader.schema();
+        table.lsn = reader.u64();
+        table.rows = reader.u64();
+
+        // Every row takes at least its null flag, so this bounds the
+        // sizes computed below.
+        if (table.rows > reader.left()) {
+            throw sql::Exception("malformed binary data");
+        }
+
+        for (const ColumnInfo& columnInfo : table.schema)
+        {
+            Column column;
+            column.type = columnInfo.type();
+            column.nulls = reader.take(table.rows);
+            column.bytes = nullptr;
+            column.byteCount = 0;
+            if (column.type == sql::DataType::INTEGER) {
+                column.values = reader.take(table.rows * 8);
+            }
+            else
+            {
+                column.values = reader.take((table.rows + 1) * 8);
+                column.byteCount = getU64(column.values + table.rows * 8);
+                column.bytes = reader.take(column.byteCount);
+            }
+            table.columns.push_back(column);
+        }
+
+        for (std::uint32_t k = reader.u32(); k > 0; --k)
+        {
+            Index index;
+            index.column = reader.u32();
+            index.size = reader.u64();
+            if (index.column >= table.schema.size() ||
+                index.size > table.rows)
+            {
+                throw sql::Exception("malformed binary data");
+            }
+            index.rows = reader.take(index.size * 8);
+            table.indices.push_back(index);
+        }
+
+        m_tables.push_back(std::move(table));
+    }
+}
+
+
+std::size_t snapshot_file::File::Index::row(std::size_t i) const
+{
+    return getU64(rows + i * 8);
+}
+
+
+DataObject snapshot_file::File::Table::value(std::size_t row,
+                                             std::size_t col) const
+{
+    const Column& column = columns[col];
+    if (column.nulls[row]) {
+        return DataObject(column.type);
+    }
+
+    if (column.type == sql::DataType::INTEGER) {
+        return DataObject(long(getU64(column.values + row * 8)));
+    }
+
+    std::uint64_t begin = getU64(column.values + row * 8);
+    std::uint64_t end = getU64(column.values + (row + 1) * 8);
+    if (begin > end || end > column.byteCount) {
+        throw sql::Exception("malformed binary data");
+    }
+    return DataObject(std::string(column.bytes + begin, end - begin));
+}
+
+
+Record snapshot_file::File::Table::row(std::size_t row) const
+{
+    Record values;
+    values.reserve(columns.size());
+    for (std::size_t col = 0; col < columns.size(); ++col) {
+        values.push_back(value(row, col));
+    }
+    return values;
+}
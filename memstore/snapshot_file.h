@@ -0,0 +1,92 @@
+#ifndef SNAPSHOT_FILE_H
+#define SNAPSHOT_FILE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "table.h"
+#include "mapped_file.h"
+
+// The tables of a Memstore written out in one binary file:
+//
+//   "MEMSNAP1" | u32 tables | table...
+//
+// and for each table its name, schema, LSN, row count, then the columns
+// one after another and the indices:
+//
+//   INTEGER column:  rows x u8 null | rows x u64 value
+//   TEXT column:     rows x u8 null | (rows + 1) x u64 offset | bytes
+//   index:           u32 column | u64 n | n x u64 row, in key order
+//
+// Values are fixed size or reached through offsets, so a row is decoded
+// straight from the mapped file without parsing the ones before it. The
+// file is written next to its final name and renamed over it, so a crash
+// leaves either the old snapshot or the new one.
+namespace snapshot_file
+{
+// A table to write: the live rows of the snapshot are stored.
+struct Source
+{
+    std::string              name;
+    Schema                   schema;
+    std::uint64_t            lsn;        // last log entry the rows include
+    Table::Snapshot          rows;
+    std::vector<std::size_t> indexed;
+};
+
+// Replaces the file at path with one holding the tables, and returns
+// once the new file is on disk under that name.
+void write(const std::string& path, const std::vector<Source>& tables);
+
+
+// A snapshot file mapped into memory. The tables point into the mapping
+// and are valid while the file is open.
+class File
+{
+public:
+    struct Column
+    {
+        sql::DataType  type;
+        const char    *nulls;
+        const char    *values;     // u64 values or offsets
+        const char    *bytes;      // TEXT only
+        std::size_t    byteCount;
+    };
+
+    struct Index
+    {
+        std::size_t  column;
+        std::size_t  size;
+        const char  *rows;
+
+        std::size_t row(std::size_t i) const;
+    };
+
+    struct Table
+    {
+        std::string          name;
+        Schema               schema;
+        std::uint64_t        lsn;
+        std::size_t          rows;
+        std::vector<Column>  columns;
+        std::vector<Index>   indices;
+
+        DataObject value(std::size_t row, std::size_t col) const;
+        Record row(std::size_t row) const;
+    };
+
+    // A missing file reads as one without tables.
+    explicit File(const std::string& path);
+
+    const std::vector<Table>& tables() const noexcept { return m_tables; }
+
+private:
+    std::unique_ptr<MappedFile>  m_file;
+    std::vector<Table>           m_tables;
+};
+
+} // namespace snapshot_file
+
+#endif // SNAPSHOT_FILE_H
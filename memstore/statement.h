@@ -7,43 +7,66 @@
 void assertEq(const std::string& have, const std::string& expect);
 Schema parseSchema(const std::string& s);
 std::vector<DataObject> parseValues(const std::string& s, const Schema& schema);
+DataObject parseValue(const std::string& s, const ColumnInfo& column);
 
 
 class Statement : public sql::IStatement
 {
-    Memstore        *m_db;
-    sql::ISelection *m_selection;
+    // The text of a query as it is parsed, kept in the statement's memory.
+    using Query = std::basic_istringstream<char, std::char_traits<char>,
+                                           std::pmr::polymorphic_allocator<char>>;
+    using Tokens = std::pmr::vector<std::string>;
+
+    // Names of the selected columns, viewing the text of the query.
+    using Columns = std::pmr::vector<std::string_view>;
+
+    Memstore                  *m_db;
+    std::pmr::memory_resource *m_memory;
+
+    // The selection of the last query, made in m_memory.
+    SelectionPtr               m_selection;
 
 public:
-    Statement(Memstore* db) : m_db(db), m_selection(nullptr) {}
-    ~Statement() { close(); }
+    Statement(Memstore* db, 
+              std::pmr::memory_resource* memory = std::pmr::get_default_resource()) 
+        : m_db(db), m_memory(memory) {}
 
-    void modify(const std::string& query) override {
+    void modify(std::string_view query) override {
         execute(query);
     }
 
-    sql::ISelection* select(const std::string& query) override {
+    sql::ISelection* select(std::string_view query) override {
         execute(query);
-        return m_selection;
+        return m_selection.get();
     }
 
-    void close() override { if (m_selection) delete m_selection; }
+    // The statement can run queries again after it.
+    void close() override { m_selection.reset(); }
 
 private:
-    void execute(const std::string& query);
-    void executeCreate(std::istringstream& query);
-    void executeInsert(std::istringstream& query);
-    void executeDelete(std::istringstream& query);
-    void executeSelect(std::istringstream& query);
-    void executeSelectAll(std::vector<std::string>&& tokens);
-    void executeSelectWithJoin(std::vector<std::string>&& tokens);
-    void executeSelectWithJoinWithWhere(std::vector<std::string>&& tokens);
+    void execute(std::string_view query);
+    void executeCreate(Query& query);
+    void executeCreateIndex(Query& query);
+    void executeInsert(Query& query);
+    void executeDelete(Query& query);
+    void executeLoad(Query& query);
+    void executeExplain(Query& query);
+    void executeSelect(Query& query, Profile* profile = nullptr);
+    void executeSelectAll(Tokens&& tokens,
+                          const Columns& columns,
+                          Profile* profile);
+    void executeSelectWithJoin(Tokens&& tokens,
+                               const Columns& columns,
+                               Profile* profile);
+    void executeSelectWithJoinWithWhere(Tokens&& tokens,
+                                        const Columns& columns,
+                                        Profile* profile);
 };
 
 
-void Statement::execute(const std::string& query)
+void Statement::execute(std::string_view query)
 {
-    std::istringstream sq(query);
+    Query sq(std::pmr::string(query, m_memory));
     std::string command;
 
     sq >> command;
@@ -61,22 +84,46 @@ void Statement::execute(const std::string& query)
     else if (command == "SELECT") {
         executeSelect(sq);
     }
+    else if (trimRight(command, ";") == "SNAPSHOT") {
+        m_db->snapshot();
+    }
+    else if (command == "LOAD") {
+        executeLoad(sq);
+    }
+    else if (command == "EXPLAIN") {
+        executeExplain(sq);
+    }
+    else if (trimRight(command, ";") == "MEMORY") 
+    {
+        close();
+        m_selection = m_db->memoryUsage(m_memory);
+    }
 }
 
 
-void Statement::executeCreate(std::istringstream& query)
+void Statement::executeCreate(Query& query)
 {
     std::string token;
 
     query >> token;
+    if (toUpper(token) == "INDEX") {
+        executeCreateIndex(query);
+        return;
+    }
     assertEq(toUpper(token), "TABLE");
 
     std::string tableName;
     query >> tableName;
 
-    if (m_db->hasTable(tableName)) {
-        throw sql::Exception(
-            fmt::sprintf("table %v already exists", tableName));
+    // CREATE TABLE IF NOT EXISTS table (...);
+    bool mayExist = toUpper(tableName) == "IF";
+    if (mayExist) 
+    {
+        query >> token;
+        assertEq(toUpper(token), "NOT");
+        query >> token;
+        assertEq(toUpper(token), "EXISTS");
+        query >> tableName;
     }
 
     std::string sch;
@@ -85,11 +132,46 @@ void Statement::executeCreate(std::istringstream& query)
     }
 
     Schema schema = parseSchema(sch);
-    m_db->createTable(tableName, schema);
+    m_db->createTable(tableName, schema, mayExist);
 }
 
 
-void Statement::executeInsert(std::istringstream& query)
+// CREATE INDEX [name] ON table(column);
+void Statement::executeCreateIndex(Query& query)
+{
+    std::string token;
+
+    query >> token;
+    if (toUpper(token) != "ON") {
+        query >> token;
+        assertEq(toUpper(token), "ON");
+    }
+
+    std::string target;
+    while(query >> token) {
+        target.append(token);
+    }
+
+    auto pos = target.find('(');
+    if (pos == std::string::npos) {
+        throw sql::Exception("bad index definition " + target);
+    }
+
+    std::string tableName = target.substr(0, pos);
+    std::string column = trim(target.substr(pos), " ();");
+
+    auto table = m_db->table(tableName);
+
+    if (!table->schema.contains(column)) {
+        throw sql::Exception(
+            fmt::sprintf("column %v does not exist", column));
+    }
+
+    m_db->createIndex(table, column);
+}
+
+
+void Statement::executeInsert(Query& query)
 {
     std::string token;
 
@@ -99,10 +181,7 @@ void Statement::executeInsert(std::istringstream& query)
     std::string tableName;
     query >> tableName;
 
-    if (!m_db->hasTable(tableName)) {
-        throw sql::Exception(
-            fmt::sprintf("table %v does not exist", tableName));
-    }
+    auto table = m_db->table(tableName);
 
     query >> token;
     assertEq(token, "VALUES");
@@ -112,40 +191,168 @@ void Statement::executeInsert(std::istringstream& query)
         values.append(token + " ");
     }
 
-    auto row = parseValues(values, m_db->tableSchema(tableName));
-    m_db->insert(tableName, std::move(row));
+    auto row = parseValues(values, table->schema);
+    m_db->insert(table, std::move(row));
 }
 
 
-void Statement::executeDelete(std::istringstream& query)
+// DELETE FROM table; or DELETE FROM table WHERE column = value;
+void Statement::executeDelete(Query& query)
 {
     std::string token;
     query >> token;
     assertEq(token, "FROM");
 
     query >> token;
-    std::string tableName = trimRight(token, ";");
-    m_db->truncate(tableName);
+    auto table = m_db->table(trimRight(token, ";"));
+
+    if (!(query >> token)) {
+        m_db->truncate(table);
+        return;
+    }
+    assertEq(toUpper(token), "WHERE");
+
+    std::string condition;
+    while(query >> token) {
+        condition.append(token + " ");
+    }
+
+    auto pos = condition.find('=');
+    if (pos == std::string::npos || 
+        condition.find_first_not_of(" ") == pos ||
+        condition.find_first_not_of(" ;", pos + 1) == std::string::npos) 
+    {
+        throw sql::Exception("bad delete condition " + condition);
+    }
+
+    std::string column = trim(condition.substr(0, pos));
+    std::string value = trim(condition.substr(pos + 1), " ;");
+
+    if (!table->schema.contains(column)) {
+        throw sql::Exception(
+            fmt::sprintf("column %v does not exist", column));
+    }
+
+    m_db->remove(table, column, parseValue(value, table->schema[column]));
+}
+
+
+// LOAD table path; adds the rows of a CSV file.
+void Statement::executeLoad(Query& query)
+{
+    std::string tableName, path;
+    query >> tableName >> path;
+
+    path = trimRight(path, ";");
+    if (path.empty()) {
+        throw sql::Exception("bad load: no file");
+    }
+
+    m_db->loadCsv(m_db->table(tableName), path);
+}
+
+
+// EXPLAIN [ANALYZE] SELECT ...; selects (stage, detail, rows, time_us) 
+// records: how the tables are read, the join method, and with ANALYZE 
+// the rows and microseconds of every stage, down to writing the result 
+// out as the server does.
+void Statement::executeExplain(Query& query)
+{
+    std::string token;
+    query >> token;
+
+    bool analyze = toUpper(token) == "ANALYZE";
+    if (analyze) {
+        query >> token;
+    }
+    if (toUpper(token) != "SELECT") {
+        throw sql::Exception("bad explain: only SELECT can be explained");
+    }
+
+    Profile profile(analyze);
+    executeSelect(query, &profile);
+
+    if (analyze)
+    {
+        auto start = Profile::Clock::now();
+        long rows = 0, bytes = 0;
+        sql::ColumnBatch batch(sql::ColumnBatch::DEFAULT_CAPACITY, m_memory);
+        std::pmr::string out(m_memory);
+        while (m_selection->nextBatch(batch) != 0) 
+        {
+            out.clear();
+            for (std::size_t row = 0; row < batch.size(); ++row) 
+            {
+                for (std::size_t c = 0; c < batch.columnCount(); ++c) 
+                {
+                    if (c != 0) out += ',';
+                    if (batch.isNull(c, row)) continue;
+                    if (profile.types[c] == sql::DataType::INTEGER) {
+                        out += std::to_string(batch.getLong(c, row));
+                    }
+                    else {
+                        out.append(batch.getString(c, row));
+                    }
+                }
+                out += '\n';
+            }
+            rows += batch.size();
+            bytes += out.size();
+        }
+        profile.add("serialize", fmt::sprintf("%v bytes", bytes), rows, 
+                    Profile::Clock::now() - start);
+    }
+
+    close();
+    m_selection = makeSelection<RecordSelection>(m_memory, profile.report());
 }
 
 
-void Statement::executeSelect(std::istringstream& query)
+// SELECT <columns> FROM ...; where <columns> is either * or a comma 
+// separated list of (optionally qualified) column names.
+void Statement::executeSelect(Query& query, Profile* profile)
 {
-    std::vector<std::string> tokens;
+    std::pmr::string columnList(m_memory);
     
     std::string token;
+    while(query >> token && toUpper(token) != "FROM") {
+        columnList.append(token).append(" ");
+    }
+
+    Columns columns(m_memory);
+    std::string_view list = columnList;
+    for (std::size_t start = 0; start <= list.size(); )
+    {
+        std::size_t stop = std::min(list.find(',', start), list.size());
+        std::string_view column = list.substr(start, stop - start);
+        std::size_t first = column.find_first_not_of(' ');
+        if (first == std::string_view::npos) {
+            throw sql::Exception("bad select");
+        }
+        columns.push_back(column.substr(first, 
+                                        column.find_last_not_of(' ') + 1 - first));
+        start = stop + 1;
+    }
+    if (columns.size() == 1 && columns[0] == "*") {
+        columns.clear();
+    }
+
+    Tokens tokens(m_memory);
+    if (!query.fail()) {
+        tokens.push_back(std::move(token));
+    }
     while(query >> token) {
         tokens.push_back(std::move(token));
     }
 
-    if (tokens.size() == 3) {
-        executeSelectAll(std::move(tokens));
+    if (tokens.size() == 2) {
+        executeSelectAll(std::move(tokens), columns, profile);
     } 
-    else if (tokens.size() == 9) {
-        executeSelectWithJoin(std::move(tokens));
+    else if (tokens.size() == 8) {
+        executeSelectWithJoin(std::move(tokens), columns, profile);
     }
-    else if (tokens.size() == 19) {
-        executeSelectWithJoinWithWhere(std::move(tokens));
+    else if (tokens.size() == 18) {
+        executeSelectWithJoinWithWhere(std::move(tokens), columns, profile);
     }
     else {
         throw sql::Exception("bad select");
@@ -153,45 +360,63 @@ void Statement::executeSelect(std::istringstream& query)
 }
 
 
-void Statement::executeSelectAll(std::vector<std::string>&& tokens)
+void Statement::executeSelectAll(Tokens&& tokens,
+                                 const Columns& columns,
+                                 Profile* profile)
 {
-    assertEq(tokens[0], "*");
-    assertEq(toUpper(tokens[1]), "FROM");
+    assertEq(toUpper(tokens[0]), "FROM");
 
-    std::string tableName = trimRight(tokens[2], ";");
+    auto table = m_db->table(trimRight(tokens[1], ";"));
+
+    close();
+    m_selection = m_db->selectAll(table, columns, profile, m_memory);
+}
 
-    if (!m_db->hasTable(tableName)) {
-        throw sql::Exception(
-            fmt::sprintf("table %v does not exist", tableName));
-    }
 
-    if (m_selection) delete m_selection;
-    m_selection = m_db->selectAll(tableName);
+// The column of "table.column", without the ';' ending a query.
+static std::string_view columnOf(std::string_view qualified)
+{
+    auto dot = qualified.find('.');
+    if (dot == std::string_view::npos) {
+        throw sql::Exception("bad select");
+    }
+    qualified.remove_prefix(dot + 1);
+    while (!qualified.empty() && qualified.back() == ';') {
+        qualified.remove_suffix(1);
+    }
+    return qualified;
 }
 
 
-void Statement::executeSelectWithJoin(std::vector<std::string>&& tokens)
+void Statement::executeSelectWithJoin(Tokens&& tokens,
+                                      const Columns& columns,
+                                      Profile* profile)
 {
-    std::string table1 = tokens[2];
-    std::string table2 = tokens[4];
-    std::string column1 = split(tokens[6], '.')[1];
-    std::string column2 = trimRight(split(tokens[8], '.')[1], ";");
-    
-    if (m_selection) delete m_selection;
-    m_selection = m_db->getInnerJoin(table1, table2, column1, column2);
+    auto table1 = m_db->table(tokens[1]);
+    auto table2 = m_db->table(tokens[3]);
+    std::string_view column1 = columnOf(tokens[5]);
+    std::string_view column2 = columnOf(tokens[7]);
+
+    close();
+    m_selection = m_db->getInnerJoin(table1, table2, column1, column2, 
+                                     columns, profile, m_memory);
 }
 
 
-void Statement::executeSelectWithJoinWithWhere(std::vector<std::string>&& tokens)
+void Statement::executeSelectWithJoinWithWhere(
+                                    Tokens&& tokens,
+                                    const Columns& columns,
+                                    Profile* profile)
 {
-    std::string table1 = tokens[2];
-    std::string table2 = tokens[6];
-    std::string column1 = split(tokens[8], '.')[1];
-    std::string column2 = trimRight(split(tokens[10], '.')[1], ";");
-    
-    if (m_selection) delete m_selection;
-    m_selection = m_db->getFullOuterJoin(table1, table2, column1, column2);
+    auto table1 = m_db->table(tokens[1]);
+    auto table2 = m_db->table(tokens[5]);
+    std::string_view column1 = columnOf(tokens[7]);
+    std::string_view column2 = columnOf(tokens[9]);
+
+    close();
+    m_selection = m_db->getFullOuterJoin(table1, table2, column1, column2,
+                                         columns, profile, m_memory);
 }
 
 
-#endif // STATEMENT_H
\ No newline at end of file
+#endif // STATEMENT_H
@@ -0,0 +1,126 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+#include "data_object.h"
+#include "bloom_filter.h"
+
+// Approximate count of distinct values in 1 KiB: each value's hash goes
+// to one of 1024 registers, which keeps the longest run of leading zero
+// bits seen there. The error is about 3%. Sketches of separate parts of
+// a table merge into the sketch of the whole.
+class HyperLogLog
+{
+    static const unsigned BITS = 10;
+    static const std::size_t REGISTERS = std::size_t(1) << BITS;
+
+    std::array<std::uint8_t, REGISTERS> m_registers{};
+
+public:
+    void add(std::uint64_t hash)
+    {
+        std::uint8_t& reg = m_registers[hash >> (64 - BITS)];
+        std::uint64_t rest = hash << BITS;
+        std::uint8_t rank = rest == 0 ? 64 - BITS + 1
+                                      : std::uint8_t(__builtin_clzll(rest) + 1);
+        reg = std::max(reg, rank);
+    }
+
+    void merge(const HyperLogLog& other)
+    {
+        for (std::size_t i = 0; i < REGISTERS; ++i) {
+            m_registers[i] = std::max(m_registers[i], other.m_registers[i]);
+        }
+    }
+
+    std::size_t estimate() const
+    {
+        double sum = 0;
+        std::size_t zeros = 0;
+        for (std::uint8_t reg : m_registers)
+        {
+            sum += std::ldexp(1.0, -int(reg));
+            if (reg == 0) ++zeros;
+        }
+        const double m = REGISTERS;
+        double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+
+        // Few values leave registers empty; counting those is closer.
+        if (estimate <= 2.5 * m && zeros != 0) {
+            estimate = m * std::log(m / zeros);
+        }
+        return std::size_t(estimate + 0.5);
+    }
+
+    static constexpr std::size_t bytes() { return REGISTERS; }
+};
+
+
+// Statistics of a column, kept up to date by every insert. Removals take
+// rows out of the counts but cannot shrink the range or the distinct
+// count, which stay upper bounds until the table is compacted.
+struct ColumnStats
+{
+    std::size_t  rows = 0;
+    std::size_t  nulls = 0;
+
+    // INTEGER columns only, once they have a value.
+    bool         hasRange = false;
+    long         min = 0;
+    long         max = 0;
+
+    HyperLogLog  distinct;
+
+    void add(const DataObject& value)
+    {
+        ++rows;
+        if (value.isNull())
+        {
+            ++nulls;
+            return;
+        }
+        if (value.type() == sql::DataType::INTEGER)
+        {
+            long v = value.getLong();
+            min = hasRange ? std::min(min, v) : v;
+            max = hasRange ? std::max(max, v) : v;
+            hasRange = true;
+            distinct.add(BloomFilter::hash(v));
+        }
+        else {
+            distinct.add(BloomFilter::hash(value.getString()));
+        }
+    }
+
+    void remove(bool null)
+    {
+        --rows;
+        if (null) --nulls;
+    }
+
+    void merge(const ColumnStats& other)
+    {
+        rows += other.rows;
+        nulls += other.nulls;
+        if (other.hasRange)
+        {
+            min = hasRange ? std::min(min, other.min) : other.min;
+            max = hasRange ? std::max(max, other.max) : other.max;
+            hasRange = true;
+        }
+        distinct.merge(other.distinct);
+    }
+
+    std::size_t values() const { return rows - nulls; }
+
+    // Never more than the values themselves.
+    std::size_t distinctCount() const {
+        return std::min(distinct.estimate(), values());
+    }
+};
+
+#endif // STATS_H
@@ -1,93 +1,1049 @@
 #ifndef STORAGE_H
 #define STORAGE_H
 
-#include <map>
+#include <algorithm>
+#include <initializer_list>
+#include <memory>
 #include <mutex>
 #include <shared_mutex>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "memstore.h"
 #include "table.h"
 #include "selection.h"
+#include "intersect.h"
+#include "radix_join.h"
+#include "thread_pool.h"
+#include "background_worker.h"
+#include "wal.h"
+#include "snapshot_file.h"
+#include "csv_loader.h"
+#include "join_planner.h"
+#include "explain.h"
+#include "combiner.h"
 
 
-class Memstore : public ITableLocker
+// Shared locks on the tables of a query.
+using TableLocks = std::vector<std::shared_lock<std::shared_mutex>>;
+
+
+// How a join reads each table and finds its pairs, reported by EXPLAIN.
+struct JoinMethod
 {
-    struct table_t 
+    enum class Access { NONE, SCAN, INDEX };
+
+    bool         run = true;    // false stops once the method is chosen
+    std::string  name;
+    Access       access1 = Access::NONE;
+    Access       access2 = Access::NONE;
+
+    void set(const std::string& method, Access first, Access second)
     {
-        Table *table;
-        std::shared_mutex mutex;
+        name = method;
+        access1 = first;
+        access2 = second;
+    }
+};
+
+
+class Memstore
+{
+public:
+    // A table split into shards by the hash of the primary key. Every 
+    // shard has its own rows, indices and lock. Statements resolve a name 
+    // to a handle once and work with the handle from then on.
+    struct TableEntry
+    {
+        // A row on its way into a shard, with its log entry; `lsn` is set
+        // once it is in.
+        struct PendingInsert
+        {
+            std::vector<DataObject>  row;
+            std::string              entry;
+            std::uint64_t            lsn;
+        };
+
+        struct Shard
+        {
+            Shard(const Schema& schema, 
+                  std::shared_ptr<memory::Counter> memory,
+                  std::shared_ptr<Table::Dictionary> dictionary) 
+                : table(schema, std::move(memory), std::move(dictionary)) {}
+
+            Table              table;
+            std::shared_mutex  mutex;
+
+            // Inserts at the same time are applied together under the lock.
+            Combiner<PendingInsert> inserts;
+        };
+
+        TableEntry(const std::string& tableName, const Schema& tableSchema,
+                   std::size_t shardCount, 
+                   const std::shared_ptr<memory::Counter>& memory,
+                   const std::shared_ptr<Table::Dictionary>& dictionary);
+
+        const std::string                    name;
+        const Schema                         schema;
+        std::vector<std::unique_ptr<Shard>>  shards;
+
+        Shard& shardOf(const std::vector<DataObject>& row) const;
+        Shard& shardOfKey(const DataObject& key) const;
+        std::size_t shardIndex(const DataObject& key) const;
+
+        // Exclusive locks on every shard, taken in shard order.
+        std::vector<std::unique_lock<std::shared_mutex>> lockAll() const;
+
+        // Snapshots of the shards, each taken under the shared lock of 
+        // its shard, laid end to end. Their lists are kept in `memory`.
+        Table::Snapshot snapshot(std::pmr::memory_resource* memory = 
+                                    std::pmr::get_default_resource()) const;
     };
 
-    std::shared_mutex m_tablesMutex;
-    std::map<std::string, table_t> m_tables;
+    using TableHandle = std::shared_ptr<TableEntry>;
+
+private:
+    using Registry = std::unordered_map<std::string, TableHandle>;
+
+    // Everything the tables and the open selections hold; the second 
+    // counter is the part of it taken by join results.
+    std::shared_ptr<memory::Counter> m_memory;
+    std::shared_ptr<memory::Counter> m_selectionMemory;
+
+    // Shared by all tables, so encoded columns join on their codes.
+    std::shared_ptr<Table::Dictionary> m_dictionary;
+
+    // Copied and republished on every CREATE TABLE, which is rare; 
+    // lookups take no lock at all.
+    std::shared_ptr<const Registry> m_registry;
+    std::mutex                      m_createMutex;
+
+    ThreadPool  m_joinPool;
+    std::size_t m_tableShards;
+
+    // Null when the data is kept in memory only.
+    std::unique_ptr<wal::Log> m_log;
+
+    std::string m_snapshotPath;
+    std::mutex  m_snapshotMutex;
+
+    // Declared last: its tasks use the members above, so it must stop 
+    // before they are destroyed.
+    BackgroundWorker m_background;
+
+    // How often tables are checked for removed rows to reclaim.
+    static constexpr std::chrono::milliseconds COMPACTION_INTERVAL{1000};
+    static const int COMPACTION_ATTEMPTS = 3;
 
 public:
-    void createTable(const std::string& tableName, const Schema& schema) 
+    explicit Memstore(const mem::Options& options)
+        : m_memory(std::make_shared<memory::Counter>()),
+          m_selectionMemory(std::make_shared<memory::Counter>(m_memory)),
+          m_dictionary(std::make_shared<Table::Dictionary>(m_memory)),
+          m_registry(std::make_shared<Registry>()),
+          m_joinPool(options.joinThreads ? options.joinThreads 
+                                         : std::thread::hardware_concurrency()),
+          m_tableShards(std::max<std::size_t>(options.tableShards, 1)),
+          m_snapshotPath(options.snapshotPath)
+    {
+        // The last log entry each table of the snapshot includes.
+        std::unordered_map<std::string, std::uint64_t> loaded;
+        std::uint64_t lastLsn = 0;
+
+        if (!m_snapshotPath.empty()) 
+        {
+            snapshot_file::File file(m_snapshotPath);
+            for (const auto& table : file.tables()) 
+            {
+                load(table);
+                loaded[table.name] = table.lsn;
+                lastLsn = std::max(lastLsn, table.lsn);
+            }
+        }
+
+        if (!options.walPath.empty()) 
+        {
+            // Replayed through the usual operations before the log is 
+            // opened, so nothing is logged twice.
+            lastLsn = std::max(lastLsn, wal::Log::replay(options.walPath, 
+                [&](wal::Entry&& entry) 
+                {
+                    auto found = loaded.find(entry.table);
+                    if (found == loaded.end() || entry.lsn > found->second) {
+                        apply(std::move(entry));
+                    }
+                }));
+
+            m_log = std::make_unique<wal::Log>(
+                        options.walPath, options.durability,
+                        std::chrono::milliseconds(options.walIntervalMs), 
+                        lastLsn);
+        }
+
+        // Only enforced from here on: the data that was accepted before 
+        // a restart is not refused after it.
+        m_memory->setLimit(options.memoryLimit);
+
+        m_background.every(COMPACTION_INTERVAL, [this]() { compact(); });
+        if (options.snapshotIntervalSec) {
+            m_background.every(std::chrono::seconds(options.snapshotIntervalSec),
+                               [this]() { snapshot(); });
+        }
+    }
+
+    // With mayExist an existing table of that name is returned instead.
+    TableHandle createTable(const std::string& tableName, const Schema& schema,
+                            bool mayExist = false) 
+    {
+        std::uint64_t lsn;
+        TableHandle handle;
+        {
+            std::lock_guard<std::mutex> lock(m_createMutex);
+
+            auto registry = std::atomic_load(&m_registry);
+            auto found = registry->find(tableName);
+            if (found != registry->end()) 
+            {
+                if (mayExist) {
+                    return found->second;
+                }
+                throw sql::Exception(
+                    fmt::sprintf("table %v already exists", tableName));
+            }
+
+            handle = std::make_shared<TableEntry>(tableName, schema, 
+                                                  m_tableShards, m_memory,
+                                                  m_dictionary);
+            logCheck();
+            auto updated = std::make_shared<Registry>(*registry);
+            updated->emplace(tableName, handle);
+
+            // Logged before the table is published: entries of changes
+            // to it must come after this one.
+            lsn = logAppend([&]() { 
+                return wal::encodeCreateTable(tableName, schema); 
+            });
+            std::atomic_store(&m_registry, 
+                              std::shared_ptr<const Registry>(std::move(updated)));
+        }
+        logCommit(lsn);
+        return handle;
+    }
+
+    // nullptr if there is no such table.
+    TableHandle findTable(const std::string& tableName) const
+    {
+        auto registry = std::atomic_load(&m_registry);
+        auto found = registry->find(tableName);
+        return found == registry->end() ? nullptr : found->second;
+    }
+
+    TableHandle table(const std::string& tableName) const
     {
-        std::unique_lock<std::shared_mutex> lock(m_tablesMutex);
-        m_tables[tableName].table = new Table(schema);
+        TableHandle handle = findTable(tableName);
+        if (!handle) {
+            throw sql::Exception(
+                fmt::sprintf("table %v does not exist", tableName));
+        }
+        return handle;
     }
 
-    bool hasTable(const std::string& tableName)
+    // Writers inserting into a shard at the same time do not take turns 
+    // on its lock: whichever gets there first inserts all their rows, 
+    // each of which succeeds or fails on its own.
+    void insert(const TableHandle& tab, std::vector<DataObject>&& row) 
     {
-        std::shared_lock<std::shared_mutex> lock(m_tablesMutex);
-        return m_tables.find(tableName) != m_tables.end();
+        TableEntry::Shard& shard = tab->shardOf(row);
+
+        // Encoded before the row is moved into the table.
+        TableEntry::PendingInsert pending{
+            {}, m_log ? wal::encodeInsert(tab->name, row) : std::string(), 0};
+        pending.row = std::move(row);
+
+        shard.inserts.run(pending, shard.mutex, 
+            [this, &shard](TableEntry::PendingInsert& insert) 
+            {
+                logCheck();
+                m_memory->check(shard.table.footprint(insert.row) + 
+                                shard.table.growth());
+                shard.table.insert(std::move(insert.row));
+                insert.lsn = logAppend([&]() { return std::move(insert.entry); });
+            });
+        logCommit(pending.lsn);
     }
 
-    const Schema& tableSchema(const std::string& tableName) 
+    // Only swaps storage under the locks; the old rows are freed on the 
+    // background thread, and then the dictionary entries only they held.
+    void truncate(const TableHandle& tab) 
     {
-        std::shared_lock<std::shared_mutex> lock(m_tablesMutex);
-        return m_tables[tableName].table->schema();
+        auto retired = std::make_shared<
+                            std::vector<std::unique_ptr<Table::Retired>>>();
+        std::uint64_t lsn;
+        {
+            auto locks = tab->lockAll();
+            logCheck();
+            for (auto& shard : tab->shards) {
+                retired->push_back(shard->table.truncate());
+            }
+            lsn = logAppend([&]() { return wal::encodeTruncate(tab->name); });
+        }
+        m_background.post([retired, dictionary = m_dictionary]() { 
+            retired->clear(); 
+            dictionary->sweep();
+        });
+        logCommit(lsn);
     }
 
-    void insert(const std::string& tableName, std::vector<DataObject>&& row) 
+    // Removes the rows with the value in the column, returns how many.
+    std::size_t remove(const TableHandle& tab, const std::string& column,
+                       const DataObject& value)
     {
-        std::shared_lock<std::shared_mutex> lockStorage(m_tablesMutex);
-        std::unique_lock<std::shared_mutex> lockTable(m_tables[tableName].mutex);
-        m_tables[tableName].table->insert(std::move(row));
+        std::size_t col = tab->schema.indexOf(column);
+        std::size_t removed = 0;
+        std::uint64_t lsn = 0;
+
+        auto entry = [&]() {
+            return wal::encodeRemove(tab->name, column, value);
+        };
+
+        if (col == tab->schema.primaryKeyIndex()) 
+        {
+            TableEntry::Shard& shard = tab->shardOfKey(value);
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            logCheck();
+            removed = shard.table.removeWhere(col, value);
+            if (removed) lsn = logAppend(entry);
+        }
+        else 
+        {
+            // All shards at once, so no insert can be logged between the
+            // shards this removal has and has not seen yet.
+            auto locks = tab->lockAll();
+            logCheck();
+            for (auto& shard : tab->shards) {
+                removed += shard->table.removeWhere(col, value);
+            }
+            if (removed) lsn = logAppend(entry);
+        }
+        logCommit(lsn);
+        return removed;
     }
 
-    void truncate(const std::string& tableName) 
+    // Adds the rows of a CSV file, all of them or none if one is bad. The
+    // file is parsed in parallel before the table is locked; under the 
+    // locks the shards are checked, then filled, in parallel too. 
+    // Returns how many rows were added.
+    std::size_t loadCsv(const TableHandle& tab, const std::string& path)
     {
-        std::shared_lock<std::shared_mutex> lockStorage(m_tablesMutex);
-        std::unique_lock<std::shared_mutex> lockTable(m_tables[tableName].mutex);
-        m_tables[tableName].table->truncate();
+        auto rows = csv::parse(path, tab->schema, tab->shards.size(), 
+            [&tab](const Record& row) { 
+                return tab->shardIndex(row[tab->schema.primaryKeyIndex()]); 
+            }, 
+            m_joinPool);
+
+        std::size_t count = 0;
+        for (const auto& shardRows : rows) count += shardRows.size();
+
+        std::uint64_t lsn;
+        {
+            auto locks = tab->lockAll();
+            logCheck();
+
+            std::size_t bytes = 0;
+            for (std::size_t s = 0; s < rows.size(); ++s) {
+                for (const Record& row : rows[s]) {
+                    bytes += tab->shards[s]->table.footprint(row);
+                }
+            }
+            m_memory->check(bytes);
+
+            m_joinPool.parallelFor(rows.size(), [&](std::size_t s) {
+                tab->shards[s]->table.validate(rows[s]);
+            });
+            m_joinPool.parallelFor(rows.size(), [&](std::size_t s) {
+                tab->shards[s]->table.insertAll(std::move(rows[s]));
+            });
+            lsn = logAppend([&]() { return wal::encodeLoad(tab->name, path); });
+        }
+        logCommit(lsn);
+        return count;
+    }
+
+    // Reclaims the space of removed rows in every shard that has enough 
+    // of them, and encodes the TEXT columns that repeat their values 
+    // enough. Writers of a shard wait while its live rows are copied; 
+    // readers only wait for the swap.
+    // A shard written while it was being copied is copied again, a few 
+    // times at most; one that is never quiet enough waits for the next
+    // round.
+    void compact()
+    {
+        auto registry = std::atomic_load(&m_registry);
+        for (const auto& entry : *registry) 
+        {
+            for (const auto& shard : entry.second->shards) 
+            {
+                for (int attempt = 0; attempt < COMPACTION_ATTEMPTS && 
+                                      !compactShard(*shard); ++attempt) {}
+            }
+        }
     }
 
-    void lock_shared(const std::string& tableName)
+    // Writes every table to the snapshot file. Each table is read under 
+    // its locks only long enough to take a snapshot of its rows.
+    void snapshot();
+
+    void createIndex(const TableHandle& tab, const std::string& column)
     {
-        m_tablesMutex.lock_shared();
-        m_tables[tableName].mutex.lock_shared();
+        m_memory->check();
+        std::size_t col = tab->schema.indexOf(column);
+        std::uint64_t lsn;
+        {
+            auto locks = tab->lockAll();
+            logCheck();
+            for (auto& shard : tab->shards) {
+                shard->table.createIndex(col);
+            }
+            lsn = logAppend([&]() { 
+                return wal::encodeCreateIndex(tab->name, column); 
+            });
+        }
+        logCommit(lsn);
+    }
+
+    // An empty list of columns selects all of them. Queries given a 
+    // profile report their stages to it. The selections are made in 
+    // `memory` and keep their row ids there.
+    SelectionPtr selectAll(const TableHandle& tab,
+                           const std::pmr::vector<std::string_view>& columns,
+                           Profile* profile = nullptr,
+                           std::pmr::memory_resource* memory = 
+                                std::pmr::get_default_resource()) 
+    {
+        std::pmr::vector<std::size_t> projection(memory);
+        projection.reserve(columns.size());
+        for (std::string_view column : columns) {
+            projection.push_back(resolveColumn(column, {tab.get()}).second);
+        }
+
+        auto start = Profile::Clock::now();
+        Table::Snapshot snapshot = tab->snapshot(memory);
+        if (profile) 
+        {
+            long rows = snapshot.size();
+            profile->add("materialize", tab->name, rows, 
+                         Profile::Clock::now() - start);
+            profile->add("scan", tab->name + ": full scan", rows);
+            for (std::size_t i = 0; projection.empty() && 
+                                    i < tab->schema.size(); ++i) {
+                profile->types.push_back(tab->schema.typeOf(i));
+            }
+            for (std::size_t col : projection) {
+                profile->types.push_back(tab->schema.typeOf(col));
+            }
+        }
+        return makeSelection<FullTableSelection>(memory, std::move(snapshot),
+                                                 std::move(projection), memory);
+    }
+
+    SelectionPtr getInnerJoin(const TableHandle& table1,  
+                              const TableHandle& table2, 
+                              std::string_view column1, 
+                              std::string_view column2,
+                              const std::pmr::vector<std::string_view>& columns,
+                              Profile* profile = nullptr,
+                              std::pmr::memory_resource* memory = 
+                                  std::pmr::get_default_resource());
+
+    SelectionPtr getFullOuterJoin(const TableHandle& table1,
+                                  const TableHandle& table2,
+                                  std::string_view column1,
+                                  std::string_view column2,
+                                  const std::pmr::vector<std::string_view>& columns,
+                                  Profile* profile = nullptr,
+                                  std::pmr::memory_resource* memory = 
+                                      std::pmr::get_default_resource());
+
+    // Bytes held by the rows, indices and statistics of every table, by
+    // the dictionary, by open selections, and in all, as (name, bytes) 
+    // records. The total also counts rows still held by snapshots or 
+    // waiting to be freed.
+    SelectionPtr memoryUsage(std::pmr::memory_resource* memory = 
+                                std::pmr::get_default_resource()) const;
+
+private:
+    // Refuses a change, before it is applied, once the log has failed.
+    void logCheck() {
+        if (m_log) m_log->check();
+    }
+
+    // Logs a change that has just been applied. Called under the locks 
+    // of the change, so the log orders changes as they were made; the 
+    // entry is only built when there is a log. Returns 0 without a log.
+    template<typename Encode>
+    std::uint64_t logAppend(Encode encode) {
+        return m_log ? m_log->append(encode()) : 0;
+    }
+
+    // Waits, outside the locks, until the change is as durable as asked.
+    void logCommit(std::uint64_t lsn) {
+        if (lsn) m_log->commit(lsn);
+    }
+
+    // Redoes a logged change.
+    void apply(wal::Entry&& entry);
+
+    // Creates a table from a snapshot file. Rows are decoded from the
+    // mapping into their shards, which are filled in parallel, and the 
+    // indices are built from the key order stored in the file.
+    void load(const snapshot_file::File::Table& image);
+
+    // Returns false if the shard was written while it was copied, and
+    // so is left as it was. The old rows are freed on the background 
+    // thread, as truncate does.
+    bool compactShard(TableEntry::Shard& shard)
+    {
+        std::unique_ptr<Table> compacted;
+        {
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            std::size_t dead = shard.table.tombstones();
+            bool reclaim = dead != 0 && dead * 4 >= shard.table.size();
+            if (!reclaim && !shard.table.wantsEncoding()) {
+                return true;
+            }
+            compacted = shard.table.compacted();
+        }
+
+        std::shared_ptr<Table::Retired> retired;
+        {
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            retired = shard.table.install(std::move(compacted));
+        }
+        if (!retired) {
+            return false;
+        }
+        m_background.post([retired, dictionary = m_dictionary]() mutable { 
+            retired.reset(); 
+            dictionary->sweep();
+        });
+        return true;
     }
 
-    void unlock_shared(const std::string& tableName) override
+    // Held while the join is computed; the selection itself reads from
+    // snapshots and needs no locks. A shard listed twice is locked once.
+    static TableLocks lockShared(const std::vector<TableEntry::Shard*>& shards)
     {
-        m_tables[tableName].mutex.unlock_shared();
-        m_tablesMutex.unlock_shared();
+        TableLocks locks;
+        for (auto iter = shards.begin(); iter != shards.end(); ++iter) 
+        {
+            if (std::find(shards.begin(), iter, *iter) == iter) {
+                locks.emplace_back((*iter)->mutex);
+            }
+        }
+        return locks;
     }
 
-    FullTableSelection* selectAll(const std::string& tableName) 
+    // Both tables are sharded alike and joined on their primary keys, so
+    // equal keys are always in shards with the same number.
+    static bool coSharded(const TableEntry& table1, const TableEntry& table2,
+                          std::size_t col1, std::size_t col2)
     {
-        this->lock_shared(tableName);
-        Table *tab = m_tables[tableName].table;
-        return new FullTableSelection(this, tableName, tab->begin(), tab->end());
+        return table1.shards.size() > 1 &&
+               table1.shards.size() == table2.shards.size() &&
+               table1.schema.primaryKeyIndex() == col1 &&
+               table2.schema.primaryKeyIndex() == col2 &&
+               table1.schema.typeOf(col1) == table2.schema.typeOf(col2);
     }
 
-    Selection* getInnerJoin(const std::string& table1,  
-                            const std::string& table2, 
-                            const std::string& column1, 
-                            const std::string& column2);
+    // Finds the row pairs with `find`, called on the whole tables or on
+    // each pair of shards of co-sharded tables.
+    template<typename Find>
+    SelectionPtr join(const TableHandle& table1, const TableHandle& table2,
+                      std::string_view column1, std::string_view column2,
+                      const std::pmr::vector<std::string_view>& columns, 
+                      Profile* profile, std::pmr::memory_resource* memory, 
+                      Find find);
 
-    Selection* getFullOuterJoin(const std::string& table1,
-                                const std::string& table2,
-                                const std::string& column1,
-                                const std::string& column2);
+    // Finds "column" or "table.column" among the tables of a selection,
+    // returns the indices of the table and of the column in it.
+    static std::pair<std::size_t, std::size_t> resolveColumn(
+                                std::string_view name,
+                                std::initializer_list<const TableEntry*> tables);
+
+    // Only the requested columns are read from the tables; an empty list 
+    // selects every column of both. Made in `memory`.
+    static std::pmr::vector<Selection::Info::Column> projectJoin(
+            const TableEntry& table1, const TableEntry& table2,
+            const std::pmr::vector<std::string_view>& columns,
+            std::pmr::memory_resource* memory);
+
+    SelectionPtr makeJoinSelection(
+            Table::Snapshot&& tab1, Table::Snapshot&& tab2,
+            std::vector<std::pair<Table::RowID, Table::RowID>>&& rowPairs,
+            std::pmr::vector<Selection::Info::Column>&& columns,
+            Profile* profile, std::pmr::memory_resource* memory);
 };
 
 
+void Memstore::apply(wal::Entry&& entry)
+{
+    switch (entry.op)
+    {
+    case wal::Op::CREATE_TABLE:
+        createTable(entry.table, entry.schema);
+        break;
+
+    case wal::Op::CREATE_INDEX:
+        createIndex(table(entry.table), entry.column);
+        break;
+
+    case wal::Op::INSERT:
+        insert(table(entry.table), std::move(entry.values));
+        break;
+
+    case wal::Op::REMOVE:
+        remove(table(entry.table), entry.column, entry.values.at(0));
+        break;
+
+    case wal::Op::TRUNCATE:
+        truncate(table(entry.table));
+        break;
+
+    case wal::Op::LOAD:
+        loadCsv(table(entry.table), entry.column);
+        break;
+    }
+}
+
+
+void Memstore::snapshot()
+{
+    if (m_snapshotPath.empty()) {
+        throw sql::Exception("snapshots are not enabled");
+    }
+    std::lock_guard<std::mutex> snapshotLock(m_snapshotMutex);
+
+    // Every table in the registry is in the snapshot with at least the
+    // entries up to here; a table created later has all of its own after.
+    // Both are read under the creation lock: a table is logged before it
+    // is published, and must not be logged by then but not yet listed.
+    std::uint64_t covered;
+    std::shared_ptr<const Registry> registry;
+    {
+        std::lock_guard<std::mutex> lock(m_createMutex);
+        covered = m_log ? m_log->lastLsn() : 0;
+        registry = std::atomic_load(&m_registry);
+    }
+
+    std::vector<snapshot_file::Source> tables;
+    for (const auto& entry : *registry) 
+    {
+        const TableEntry& tab = *entry.second;
+        snapshot_file::Source source{tab.name, tab.schema, 0, {}, {}};
+
+        std::pmr::vector<Table::Snapshot> shards;
+        {
+            std::vector<TableEntry::Shard*> all;
+            for (const auto& shard : tab.shards) all.push_back(shard.get());
+            TableLocks locks = lockShared(all);
+
+            // Changes are logged under the locks of their table, so every
+            // entry of this table up to here is in the rows and none after.
+            source.lsn = m_log ? m_log->lastLsn() : 0;
+
+            for (const auto& shard : tab.shards) {
+                shards.push_back(shard->table.snapshot());
+            }
+            const Table& first = tab.shards[0]->table;
+            for (std::size_t col = 0; col < tab.schema.size(); ++col) {
+                if (first.hasIndex(col)) source.indexed.push_back(col);
+            }
+        }
+        source.rows = Table::Snapshot::concat(std::move(shards));
+        tables.push_back(std::move(source));
+    }
+
+    snapshot_file::write(m_snapshotPath, tables);
+
+    // A restart loads the snapshot, which write() has made durable under
+    // its name, so the log only needs what follows.
+    if (covered) m_log->trim(covered);
+}
+
+
+void Memstore::load(const snapshot_file::File::Table& image)
+{
+    TableHandle tab = createTable(image.name, image.schema);
+    std::size_t pkey = image.schema.primaryKeyIndex();
+
+    // The shard of every row and its id in there.
+    std::vector<std::size_t> shardOf(image.rows, 0);
+    std::vector<Table::RowID> local(image.rows);
+    if (tab->shards.size() > 1) {
+        for (std::size_t row = 0; row < image.rows; ++row) {
+            shardOf[row] = tab->shardIndex(image.value(row, pkey));
+        }
+    }
+
+    m_joinPool.parallelFor(tab->shards.size(), [&](std::size_t s) 
+    {
+        TableEntry::Shard& shard = *tab->shards[s];
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+
+        for (std::size_t row = 0; row < image.rows; ++row) {
+            if (shardOf[row] == s) local[row] = shard.table.append(image.row(row));
+        }
+
+        for (const auto& index : image.indices) 
+        {
+            std::vector<Table::RowID> sorted;
+            for (std::size_t i = 0; i < index.size; ++i) 
+            {
+                std::size_t row = index.row(i);
+                if (row >= image.rows) {
+                    throw sql::Exception("malformed binary data");
+                }
+                if (shardOf[row] == s) sorted.push_back(local[row]);
+            }
+            shard.table.buildIndex(index.column, sorted);
+        }
+    });
+}
+
+
+SelectionPtr Memstore::memoryUsage(std::pmr::memory_resource* memory) const
+{
+    auto registry = std::atomic_load(&m_registry);
+    std::vector<std::string> names;
+    for (const auto& entry : *registry) names.push_back(entry.first);
+    std::sort(names.begin(), names.end());
+
+    std::vector<Record> records;
+    auto add = [&records](const std::string& name, std::size_t bytes) {
+        records.push_back({DataObject(name), DataObject(long(bytes))});
+    };
+
+    for (const std::string& name : names) 
+    {
+        Table::Usage usage;
+        for (const auto& shard : registry->at(name)->shards) 
+        {
+            std::shared_lock<std::shared_mutex> lock(shard->mutex);
+            Table::Usage part = shard->table.usage();
+            usage.rows += part.rows;
+            usage.indices += part.indices;
+            usage.stats += part.stats;
+        }
+        add(name + ".rows", usage.rows);
+        add(name + ".indices", usage.indices);
+        add(name + ".stats", usage.stats);
+    }
+    add("dictionary", m_dictionary->bytes());
+    add("selections", m_selectionMemory->bytes());
+    add("total", m_memory->bytes());
+    add("limit", m_memory->limit());
+    return makeSelection<RecordSelection>(memory, std::move(records));
+}
+
+
+Memstore::TableEntry::TableEntry(const std::string& tableName, 
+                                 const Schema& tableSchema,
+                                 std::size_t shardCount,
+                                 const std::shared_ptr<memory::Counter>& memory,
+                                 const std::shared_ptr<Table::Dictionary>& dictionary)
+    : name(tableName), schema(tableSchema)
+{
+    for (std::size_t i = 0; i < shardCount; ++i) {
+        shards.push_back(std::make_unique<Shard>(schema, memory, dictionary));
+    }
+}
+
+
+Memstore::TableEntry::Shard& 
+Memstore::TableEntry::shardOf(const std::vector<DataObject>& row) const
+{
+    // A malformed row may go anywhere, the table rejects it.
+    std::size_t pkey = schema.primaryKeyIndex();
+    return pkey < row.size() ? shardOfKey(row[pkey]) : *shards[0];
+}
+
+
+Memstore::TableEntry::Shard& 
+Memstore::TableEntry::shardOfKey(const DataObject& key) const
+{
+    return *shards[shardIndex(key)];
+}
+
+
+std::size_t Memstore::TableEntry::shardIndex(const DataObject& key) const
+{
+    if (shards.size() == 1 || key.isNull() || 
+        key.type() != schema.typeOf(schema.primaryKeyIndex()))
+    {
+        return 0;
+    }
+
+    std::size_t hash = key.type() == sql::DataType::INTEGER 
+                        ? std::hash<long>()(key.getLong())
+                        : std::hash<std::string>()(key.getString());
+    return hash % shards.size();
+}
+
+
+std::vector<std::unique_lock<std::shared_mutex>> 
+Memstore::TableEntry::lockAll() const
+{
+    std::vector<std::unique_lock<std::shared_mutex>> locks;
+    for (const auto& shard : shards) {
+        locks.emplace_back(shard->mutex);
+    }
+    return locks;
+}
+
+
+Table::Snapshot Memstore::TableEntry::snapshot(
+                                    std::pmr::memory_resource* memory) const
+{
+    std::pmr::vector<Table::Snapshot> parts(memory);
+    parts.reserve(shards.size());
+    for (const auto& shard : shards) 
+    {
+        std::shared_lock<std::shared_mutex> lock(shard->mutex);
+        parts.push_back(shard->table.snapshot(memory));
+    }
+    return Table::Snapshot::concat(std::move(parts));
+}
+
+
+std::pair<std::size_t, std::size_t> 
+Memstore::resolveColumn(std::string_view name,
+                        std::initializer_list<const TableEntry*> tables)
+{
+    std::string_view table, column = name;
+
+    auto dot = name.find('.');
+    if (dot != std::string_view::npos) {
+        table  = name.substr(0, dot);
+        column = name.substr(dot + 1);
+    }
+
+    for (std::size_t i = 0; i < tables.size(); ++i) 
+    {
+        const TableEntry& entry = *tables.begin()[i];
+        if (!table.empty() && table != entry.name) {
+            continue;
+        }
+        if (entry.schema.contains(column)) {
+            return {i, entry.schema.indexOf(column)};
+        }
+    }
+    throw sql::Exception(fmt::sprintf("column %v does not exist", name));
+}
+
+
+std::pmr::vector<Selection::Info::Column> 
+Memstore::projectJoin(const TableEntry& table1, const TableEntry& table2,
+                      const std::pmr::vector<std::string_view>& columns,
+                      std::pmr::memory_resource* memory)
+{
+    std::pmr::vector<Selection::Info::Column> projection(memory);
+    if (columns.empty()) 
+    {
+        projection.reserve(table1.schema.size() + table2.schema.size());
+        for (std::size_t col = 0; col < table1.schema.size(); ++col) {
+            projection.push_back({table1.schema.typeOf(col), 0, col});
+        }
+        for (std::size_t col = 0; col < table2.schema.size(); ++col) {
+            projection.push_back({table2.schema.typeOf(col), 1, col});
+        }
+        return projection;
+    }
+
+    projection.reserve(columns.size());
+    for (std::string_view name : columns) 
+    {
+        auto position = resolveColumn(name, {&table1, &table2});
+        const Schema& schema = position.first == 0 ? table1.schema 
+                                                   : table2.schema;
+        projection.push_back({schema.typeOf(position.second), 
+                              position.first, position.second});
+    }
+    return projection;
+}
+
+
+SelectionPtr Memstore::makeJoinSelection(
+            Table::Snapshot&& tab1, Table::Snapshot&& tab2,
+            std::vector<std::pair<Table::RowID, Table::RowID>>&& rowPairs,
+            std::pmr::vector<Selection::Info::Column>&& columns,
+            Profile* profile, std::pmr::memory_resource* memory)
+{
+    auto start = Profile::Clock::now();
+
+    // Checked before the row ids are copied into the selection.
+    std::size_t bytes = 2 * rowPairs.size() * sizeof(Table::RowID);
+    m_memory->check(bytes);
+
+    Selection::Info selectionInfo(memory);
+    selectionInfo.memory = memory::Charge(m_selectionMemory, bytes);
+    selectionInfo.tables.reserve(2);
+    selectionInfo.tables.push_back(std::move(tab1));
+    selectionInfo.tables.push_back(std::move(tab2));
+    selectionInfo.rows.resize(2);
+
+    auto& rows1 = selectionInfo.rows[0];
+    auto& rows2 = selectionInfo.rows[1];
+    rows1.reserve(rowPairs.size());
+    rows2.reserve(rowPairs.size());
+
+    for (auto pair : rowPairs) {
+        rows1.push_back(pair.first);
+        rows2.push_back(pair.second);
+    }
+    std::vector<std::pair<Table::RowID, Table::RowID>>().swap(rowPairs);
+
+    if (profile) 
+    {
+        for (const auto& column : columns) {
+            profile->types.push_back(column.type);
+        }
+        if (profile->analyze()) {
+            profile->add("selection", "row ids", long(rows1.size()), 
+                         Profile::Clock::now() - start);
+        }
+    }
+    selectionInfo.columns = std::move(columns);
+
+    return makeSelection<Selection>(memory, std::move(selectionInfo));
+}
+
+
+template<typename Find>
+SelectionPtr Memstore::join(const TableHandle& table1, 
+                            const TableHandle& table2,
+                            std::string_view column1, 
+                            std::string_view column2,
+                            const std::pmr::vector<std::string_view>& columns, 
+                            Profile* profile, std::pmr::memory_resource* memory,
+                            Find find)
+{
+    using Clock = Profile::Clock;
+
+    m_memory->check();
+
+    std::size_t col1 = table1->schema.indexOf(column1);
+    std::size_t col2 = table2->schema.indexOf(column2);
+
+    auto projection = projectJoin(*table1, *table2, columns, memory);
+
+    std::vector<std::pair<Table::RowID, Table::RowID>> rowPairs;
+    std::pmr::vector<Table::Snapshot> shards1(memory), shards2(memory);
+    shards1.reserve(table1->shards.size());
+    shards2.reserve(table2->shards.size());
+
+    JoinMethod method;
+    method.run = !profile || profile->analyze();
+
+    // Runs `find` on a pair of snapshots, reporting how it went.
+    auto findTimed = [&](const Table::Snapshot* tab1, 
+                         const Table::Snapshot* tab2, TableLocks& locks,
+                         Clock::time_point started)
+    {
+        auto start = Clock::now();
+        auto pairs = find(tab1, tab2, col1, col2, locks, method);
+        if (profile) 
+        {
+            auto access = [](const TableEntry& table, std::size_t col,
+                             JoinMethod::Access access) {
+                switch (access)
+                {
+                case JoinMethod::Access::INDEX:
+                    return table.name + "." + table.schema[col].name() + 
+                           ": index";
+                case JoinMethod::Access::SCAN:
+                    return table.name + ": full scan";
+                default:
+                    return table.name + ": not read";
+                }
+            };
+            profile->add("materialize", 
+                         table1->name + " and " + table2->name,
+                         tab1->size() + tab2->size(), start - started);
+            profile->add("scan", access(*table1, col1, method.access1), 
+                         tab1->size());
+            profile->add("scan", access(*table2, col2, method.access2), 
+                         tab2->size());
+            if (method.run) {
+                profile->add("join", method.name, pairs.size(), 
+                             Clock::now() - start);
+            }
+            else {
+                profile->add("join", method.name);
+            }
+        }
+        return pairs;
+    };
+
+    if (!coSharded(*table1, *table2, col1, col2))
+    {
+        auto start = Clock::now();
+
+        std::vector<TableEntry::Shard*> shards;
+        for (const auto& shard : table1->shards) shards.push_back(shard.get());
+        for (const auto& shard : table2->shards) shards.push_back(shard.get());
+        TableLocks locks = lockShared(shards);
+
+        for (const auto& shard : table1->shards) {
+            shards1.push_back(shard->table.snapshot(memory));
+        }
+        for (const auto& shard : table2->shards) {
+            shards2.push_back(shard->table.snapshot(memory));
+        }
+        Table::Snapshot tab1 = Table::Snapshot::concat(std::move(shards1));
+        Table::Snapshot tab2 = Table::Snapshot::concat(std::move(shards2));
+
+        rowPairs = findTimed(&tab1, &tab2, locks, start);
+        locks.clear();
+
+        return makeJoinSelection(std::move(tab1), std::move(tab2), 
+                                 std::move(rowPairs), std::move(projection),
+                                 profile, memory);
+    }
+
+    auto shift = [](Table::RowID id, Table::RowID offset) {
+        return id == Table::RowID(-1) ? id : id + offset;
+    };
+
+    Table::RowID offset1 = 0, offset2 = 0;
+    for (std::size_t i = 0; i < table1->shards.size(); ++i) 
+    {
+        auto start = Clock::now();
+        TableLocks locks = lockShared({table1->shards[i].get(), 
+                                       table2->shards[i].get()});
+        shards1.push_back(table1->shards[i]->table.snapshot(memory));
+        shards2.push_back(table2->shards[i]->table.snapshot(memory));
+
+        for (auto pair : findTimed(&shards1.back(), &shards2.back(), 
+                                   locks, start)) 
+        {
+            rowPairs.emplace_back(shift(pair.first, offset1), 
+                                  shift(pair.second, offset2));
+        }
+        offset1 += shards1.back().size();
+        offset2 += shards2.back().size();
+    }
+
+    return makeJoinSelection(Table::Snapshot::concat(std::move(shards1)),
+                             Table::Snapshot::concat(std::move(shards2)), 
+                             std::move(rowPairs), std::move(projection),
+                             profile, memory);
+}
+
+
 template<typename T>
 std::vector<std::pair<Table::RowID, Table::RowID>> 
-findEqualRowsOnColumn(Table* tab1, Table* tab2, 
+findEqualRowsOnColumn(const Table::Snapshot* tab1,
+                      const Table::Snapshot* tab2,
                       std::size_t col1, std::size_t col2)
 {
     std::vector<std::pair<Table::RowID, Table::RowID>> ids;
@@ -112,7 +1068,8 @@ findEqualRowsOnColumn(Table* tab1, Table* tab2,
 
 template<typename T>
 std::vector<std::pair<Table::RowID, Table::RowID>>
-findEqualRowsByIndex(Table* tab1, Table* tab2,
+findEqualRowsByIndex(const Table::Snapshot* tab1,
+                     const Table::Snapshot* tab2,
                      std::size_t indexed_col1, std::size_t indexed_col2)
 {
     std::vector<std::pair<Table::RowID, Table::RowID>> rowPairs;
@@ -120,13 +1077,42 @@ findEqualRowsByIndex(Table* tab1, Table* tab2,
     auto index1 = tab1->index<T>(indexed_col1);
     auto index2 = tab2->index<T>(indexed_col2);
 
-    for (const T& val : *index1) {
-        auto iter = index2->find(val);
-        if (iter != index2->end()) {
-            for (Table::RowID id1 : index1->rows(val)) {
-                for (Table::RowID id2 : index2->rows(val)) {
-                    rowPairs.emplace_back(id1, id2);
-                }
+    auto emit = [&](const T& val) {
+        for (Table::RowID id1 : index1->find(val).rows()) {
+            for (Table::RowID id2 : index2->find(val).rows()) {
+                rowPairs.emplace_back(id1, id2);
+            }
+        }
+    };
+
+    // Integer keys are intersected as sorted arrays by the SIMD kernels.
+    if constexpr (std::is_same<T, long>::value && 
+                  sizeof(long) == sizeof(std::int64_t)) 
+    {
+        const std::vector<long>& keys1 = index1->keys();
+        const std::vector<long>& keys2 = index2->keys();
+
+        std::vector<long> common(std::min(keys1.size(), keys2.size()));
+        common.resize(intersectSorted(
+            reinterpret_cast<const std::int64_t*>(keys1.data()), keys1.size(),
+            reinterpret_cast<const std::int64_t*>(keys2.data()), keys2.size(),
+            reinterpret_cast<std::int64_t*>(common.data())));
+
+        for (long val : common) {
+            emit(val);
+        }
+    }
+    else 
+    {
+        // Both maps are in key order, so walking the smaller one and 
+        // probing the other emits the same pairs in the same order. The
+        // filter turns away most keys without a lookup.
+        bool firstSmaller = index1->keyCount() <= index2->keyCount();
+        auto walked = firstSmaller ? index1 : index2;
+        auto probed = firstSmaller ? index2 : index1;
+        for (const T& val : *walked) {
+            if (probed->mayContain(val) && probed->find(val) != probed->end()) {
+                emit(val);
             }
         }
     }
@@ -134,118 +1120,272 @@ findEqualRowsByIndex(Table* tab1, Table* tab2,
 }
 
 
-Selection* Memstore::getInnerJoin(const std::string& table1,  
-                                  const std::string& table2, 
-                                  const std::string& column1, 
-                                  const std::string& column2)
+// Builds a hash table on the smaller input and probes it with the larger
+// one. Rows with equal keys are chained through `next` in row order, so 
+// the build side needs no per-key containers.
+template<typename T>
+std::vector<std::pair<Table::RowID, Table::RowID>>
+findEqualRowsByHash(const Table::Snapshot* tab1,
+                    const Table::Snapshot* tab2,
+                    std::size_t col1, std::size_t col2, bool buildFirst)
 {
-    std::shared_lock<std::shared_mutex> lockStorage(m_tablesMutex);
-    std::shared_lock<std::shared_mutex> lockTable1(m_tables[table1].mutex);
-    std::shared_lock<std::shared_mutex> lockTable2(m_tables[table2].mutex);
+    using Key = typename HashKey<T>::type;
+    const Table::RowID none = -1;
 
-    Table *tab1 = m_tables[table1].table;
-    Table *tab2 = m_tables[table2].table;
+    const Table::Snapshot *build = buildFirst ? tab1 : tab2;
+    const Table::Snapshot *probe = buildFirst ? tab2 : tab1;
+    std::size_t buildCol = buildFirst ? col1 : col2;
+    std::size_t probeCol = buildFirst ? col2 : col1;
 
-    std::size_t col1 = tab1->schema().indexOf(column1);
-    std::size_t col2 = tab2->schema().indexOf(column2);
+    std::unordered_map<Key, Table::RowID> heads;
+    std::vector<Table::RowID> next(build->size(), none);
+    heads.reserve(build->size());
 
-    sql::DataType type = tab1->schema().typeOf(col1);
+    for (Table::RowID id = build->size(); id-- > 0; ) 
+    {
+        auto row = (*build)[id];
+        if (row.isNull(buildCol)) {
+            continue;
+        }
+        auto result = heads.emplace(Key(row.template cast<T>(buildCol)), id);
+        if (!result.second) {
+            next[id] = result.first->second;
+            result.first->second = id;
+        }
+    }
 
     std::vector<std::pair<Table::RowID, Table::RowID>> rowPairs;
-    switch (type)
+    for (auto row : *probe) 
     {
-    case sql::DataType::INTEGER:
-        if (tab1->hasIndex(col1) && tab2->hasIndex(col2)) {
-            rowPairs = findEqualRowsByIndex<long>(tab1, tab2, 
-                                                  col1, col2);
-        } 
-        else {
-            rowPairs = findEqualRowsOnColumn<long>(tab1, tab2, 
-                                                   col1, col2);
+        if (row.isNull(probeCol)) {
+            continue;
         }
-        break;
+        auto found = heads.find(Key(row.template cast<T>(probeCol)));
+        if (found == heads.end()) {
+            continue;
+        }
+        for (Table::RowID id = found->second; id != none; id = next[id]) {
+            rowPairs.emplace_back(row.id(), id);
+        }
+    }
 
-    case sql::DataType::TEXT:
-        if (tab1->hasIndex(col1) && tab2->hasIndex(col2)) {
-            rowPairs = findEqualRowsByIndex<std::string>(tab1, tab2, 
-                                                         col1, col2);
-        } 
-        else {
-            rowPairs = findEqualRowsOnColumn<std::string>(tab1, tab2, 
-                                                          col1, col2);
+    if (buildFirst) 
+    {
+        for (auto& pair : rowPairs) {
+            std::swap(pair.first, pair.second);
         }
-        break;
+        std::sort(rowPairs.begin(), rowPairs.end());
     }
+    return rowPairs;
+}
 
-    std::vector<Table::RowID> rows1;
-    std::vector<Table::RowID> rows2;
 
-    for (auto pair : rowPairs) {
-        rows1.push_back(pair.first);
-        rows2.push_back(pair.second);
+// Scans tab1 and probes the index of tab2, so the pairs come out 
+// in the same order as findEqualRowsOnColumn produces them.
+template<typename T>
+std::vector<std::pair<Table::RowID, Table::RowID>>
+findEqualRowsByLookup(const Table::Snapshot* tab1,
+                      const Table::Snapshot* tab2,
+                      std::size_t col1, std::size_t indexed_col2)
+{
+    std::vector<std::pair<Table::RowID, Table::RowID>> rowPairs;
+
+    auto index2 = tab2->index<T>(indexed_col2);
+
+    for (auto row1 : *tab1) 
+    {
+        if (row1.isNull(col1)) {
+            continue;
+        }
+        const T& value = row1.cast<T>(col1);
+        if (!index2->mayContain(value)) {
+            continue;
+        }
+        auto found = index2->find(value);
+        if (found == index2->end()) {
+            continue;
+        }
+        for (Table::RowID id2 : found.rows()) {
+            rowPairs.emplace_back(row1.id(), id2);
+        }
     }
+    return rowPairs;
+}
 
-    Selection::Info selectionInfo;
 
-    selectionInfo.tables = {tab1, tab2};
-    selectionInfo.rows   = {rows1, rows2};
+// The plans that read both tables in full and need no indices.
+template<typename T>
+std::vector<std::pair<Table::RowID, Table::RowID>>
+scanForEqualRows(const Table::Snapshot* tab1, const Table::Snapshot* tab2,
+                 std::size_t col1, std::size_t col2,
+                 ThreadPool& pool, const planner::JoinPlan& plan)
+{
+    switch (plan.algorithm)
+    {
+    case planner::JoinAlgorithm::RADIX:
+        return radix::findEqualRows<T>(tab1, tab2, col1, col2, pool);
 
-    for (const ColumnInfo& column : tab1->schema()) 
+    case planner::JoinAlgorithm::NESTED_LOOP:
+        return findEqualRowsOnColumn<T>(tab1, tab2, col1, col2);
+
+    default:
+        return findEqualRowsByHash<T>(tab1, tab2, col1, col2, 
+                                      plan.buildFirst);
+    }
+}
+
+
+template<typename T>
+std::vector<std::pair<Table::RowID, Table::RowID>>
+findEqualRows(const Table::Snapshot* tab1, const Table::Snapshot* tab2,
+              std::size_t col1, std::size_t col2,
+              ThreadPool& pool, TableLocks& locks, JoinMethod& method)
+{
+    using planner::JoinAlgorithm;
+    using Access = JoinMethod::Access;
+
+    bool parallel = pool.size() > 1 && 
+                    tab1->size() + tab2->size() >= radix::MIN_ROWS;
+
+    // Strings of two encoded columns are equal when their codes are.
+    bool codes = std::is_same<T, std::string>::value && 
+                 tab1->encoded(col1) && tab2->encoded(col2);
+    planner::JoinPlan plan = planner::planJoin(
+                            {tab1->stats(col1), tab1->hasIndex(col1), codes},
+                            {tab2->stats(col2), tab2->hasIndex(col2), codes},
+                            tab1->schema().typeOf(col1), 
+                            parallel ? pool.size() : 0);
+
+    // What each table is read through, for EXPLAIN.
+    auto access = [&plan](JoinAlgorithm lookup) {
+        if (plan.algorithm == JoinAlgorithm::EMPTY) {
+            return Access::NONE;
+        }
+        return plan.algorithm == JoinAlgorithm::INDEX_MERGE || 
+               plan.algorithm == lookup ? Access::INDEX : Access::SCAN;
+    };
+    std::string name = planner::name(plan.algorithm);
+    if (codes && access(JoinAlgorithm::LOOKUP_FIRST) == Access::SCAN &&
+        access(JoinAlgorithm::LOOKUP_SECOND) == Access::SCAN) 
     {
-        Selection::Info::Column selcol;
-        selcol.name = table1 + "." + column.name();
-        selcol.type = column.type();
-        selcol.tableIndex = 0;
-        selcol.tableColumnIndex = tab1->schema().indexOf(column.name());
-        selectionInfo.columns.push_back(selcol);
+        name += " on codes";
+    }
+    method.set(name, access(JoinAlgorithm::LOOKUP_FIRST),
+               access(JoinAlgorithm::LOOKUP_SECOND));
+    if (!method.run) {
+        return {};
     }
 
-    for (const ColumnInfo& column : tab2->schema()) 
+    switch (plan.algorithm)
     {
-        Selection::Info::Column selcol;
-        selcol.name = table2 + "." + column.name();
-        selcol.type = column.type();
-        selcol.tableIndex = 1;
-        selcol.tableColumnIndex = tab2->schema().indexOf(column.name());
-        selectionInfo.columns.push_back(selcol);
+    case JoinAlgorithm::EMPTY:
+        return {};
+
+    case JoinAlgorithm::INDEX_MERGE:
+        return findEqualRowsByIndex<T>(tab1, tab2, col1, col2);
+
+    case JoinAlgorithm::LOOKUP_SECOND:
+        return findEqualRowsByLookup<T>(tab1, tab2, col1, col2);
+
+    case JoinAlgorithm::LOOKUP_FIRST:
+        {
+            auto rowPairs = findEqualRowsByLookup<T>(tab2, tab1, col2, col1);
+            for (auto& pair : rowPairs) {
+                std::swap(pair.first, pair.second);
+            }
+            std::sort(rowPairs.begin(), rowPairs.end());
+            return rowPairs;
+        }
+
+    default:
+        break;
+    }
+
+    // The rest only reads the snapshots, so writers may go on.
+    locks.clear();
+
+    if constexpr (std::is_same<T, std::string>::value) {
+        if (codes) {
+            return scanForEqualRows<Table::Code>(tab1, tab2, col1, col2, 
+                                                 pool, plan);
+        }
     }
+    return scanForEqualRows<T>(tab1, tab2, col1, col2, pool, plan);
+}
+
+
+SelectionPtr Memstore::getInnerJoin(const TableHandle& table1,  
+                                    const TableHandle& table2, 
+                                    std::string_view column1, 
+                                    std::string_view column2,
+                                    const std::pmr::vector<std::string_view>& columns,
+                                    Profile* profile,
+                                    std::pmr::memory_resource* memory)
+{
+    return join(table1, table2, column1, column2, columns, profile, memory,
+        [this](const Table::Snapshot* tab1, const Table::Snapshot* tab2,
+               std::size_t col1, std::size_t col2, TableLocks& locks,
+               JoinMethod& method)
+        {
+            std::vector<std::pair<Table::RowID, Table::RowID>> rowPairs;
+            switch (tab1->schema().typeOf(col1))
+            {
+            case sql::DataType::INTEGER:
+                rowPairs = findEqualRows<long>(tab1, tab2, col1, col2, 
+                                               m_joinPool, locks, method);
+                break;
 
-    return new Selection(selectionInfo);
+            case sql::DataType::TEXT:
+                rowPairs = findEqualRows<std::string>(tab1, tab2, col1, col2,
+                                                      m_joinPool, locks, 
+                                                      method);
+                break;
+            }
+            return rowPairs;
+        });
 }
 
 
 template<typename T>
-bool contains(Table* table, std::size_t columnIndex, const T& value)
+std::unordered_set<typename HashKey<T>::type> 
+collectKeys(const Table::Snapshot* table, std::size_t col)
 {
-    for (Table::Row row : *table) 
+    using Key = typename HashKey<T>::type;
+
+    std::unordered_set<Key> keys;
+    keys.reserve(table->size());
+    for (auto row : *table) 
     {
-        if (row.isNull(columnIndex)) {
-            continue;
-        }
-        if (row.cast<T>(columnIndex) == value) {
-            return true;
+        if (!row.isNull(col)) {
+            keys.insert(Key(row.template cast<T>(col)));
         }
     }
-    return false;
+    return keys;
 }
 
 
+// Hash anti-join: the keys of each table are collected once, then every 
+// row is checked against the key set of the other table.
 template<typename T>
 std::vector<std::pair<Table::RowID, Table::RowID>> 
-findNonPairedRowsOnColumn(Table* tab1, Table* tab2, 
-                          std::size_t col1, std::size_t col2)
+findNonPairedRowsByHash(const Table::Snapshot* tab1,
+                        const Table::Snapshot* tab2,
+                        std::size_t col1, std::size_t col2)
 {
+    using Key = typename HashKey<T>::type;
+
+    auto keys1 = collectKeys<T>(tab1, col1);
+    auto keys2 = collectKeys<T>(tab2, col2);
+
     std::vector<std::pair<Table::RowID, Table::RowID>> ids;
     for (auto row1 : *tab1) 
     {
         if (row1.isNull(col1)) {
             continue;
         }
-        T value = row1.cast<T>(col1);
-        if (contains(tab2, col2, value)) {
-            continue;
+        if (keys2.find(Key(row1.template cast<T>(col1))) == keys2.end()) {
+            ids.emplace_back(row1.id(), std::size_t(-1));
         }
-        ids.emplace_back(row1.id(), std::size_t(-1));
     }
 
     // The same for the other table.
@@ -254,133 +1394,214 @@ findNonPairedRowsOnColumn(Table* tab1, Table* tab2,
         if (row2.isNull(col2)) {
             continue;
         }
-        T value = row2.cast<T>(col2);
-        if (contains(tab1, col1, value)) {
-            continue;
+        if (keys1.find(Key(row2.template cast<T>(col2))) == keys1.end()) {
+            ids.emplace_back(std::size_t(-1), row2.id());
         }
-        ids.emplace_back(std::size_t(-1), row2.id());
     }
     return ids;
 }
 
 
+// Both indices are ordered, so a single merge over their keys finds the 
+// unpaired ones and emits them in key order.
 template<typename T>
 std::vector<std::pair<Table::RowID, Table::RowID>>
-findNonPairedRowsByIndex(Table* tab1, Table* tab2,
+findNonPairedRowsByIndex(const Table::Snapshot* tab1,
+                         const Table::Snapshot* tab2,
                          std::size_t col1, std::size_t col2)
 {
     auto index1 = tab1->index<T>(col1);
     auto index2 = tab2->index<T>(col2);
 
-    std::multimap<T, std::pair<Table::RowID, Table::RowID>> ids;
+    auto iter1 = index1->begin(), end1 = index1->end();
+    auto iter2 = index2->begin(), end2 = index2->end();
 
-    for (const T& val1 : *index1) 
-    {
-        auto iter = index2->find(val1);
-        if (iter == index2->end()) 
-        {
-            for (Table::RowID id1 : index1->rows(val1)) {
-                ids.insert(std::make_pair(val1, std::make_pair(id1, std::size_t(-1))));
-            }
+    std::vector<std::pair<Table::RowID, Table::RowID>> ids;
+
+    auto emit1 = [&ids](const auto& iter) {
+        for (Table::RowID id1 : iter.rows()) {
+            ids.emplace_back(id1, std::size_t(-1));
         }
-    }
+    };
+    auto emit2 = [&ids](const auto& iter) {
+        for (Table::RowID id2 : iter.rows()) {
+            ids.emplace_back(std::size_t(-1), id2);
+        }
+    };
 
-    // The same for the other table.
-    for (const T& val2 : *index2) 
+    while (iter1 != end1 && iter2 != end2) 
     {
-        auto iter = index1->find(val2);
-        if (iter == index1->end()) 
-        {
-            for (Table::RowID id2 : index2->rows(val2)) {
-                ids.insert(std::make_pair(val2, std::make_pair(std::size_t(-1), id2)));
-            }
+        if (*iter1 < *iter2) {
+            emit1(iter1);
+            ++iter1;
+        }
+        else if (*iter2 < *iter1) {
+            emit2(iter2);
+            ++iter2;
+        }
+        else {
+            ++iter1;
+            ++iter2;
         }
     }
 
-    std::vector<std::pair<Table::RowID, Table::RowID>> ret;
-    ret.reserve(ids.size());
-    for (auto pair : ids) {
-        ret.push_back(pair.second);
-    }
-    return ret;
+    for (; iter1 != end1; ++iter1) emit1(iter1);
+    for (; iter2 != end2; ++iter2) emit2(iter2);
+
+    return ids;
 }
 
 
-Selection* Memstore::getFullOuterJoin(const std::string& table1,  
-                                      const std::string& table2, 
-                                      const std::string& column1, 
-                                      const std::string& column2)
+// Only one of the columns is indexed: scan the other table once, 
+// probing the index and remembering the matched values.
+template<typename T>
+std::vector<std::pair<Table::RowID, Table::RowID>>
+findNonPairedRowsByLookup(const Table::Snapshot* tab1,
+                          const Table::Snapshot* tab2,
+                          std::size_t col1, std::size_t col2)
 {
-    std::shared_lock<std::shared_mutex> lockStorage(m_tablesMutex);
-    std::shared_lock<std::shared_mutex> lockTable1(m_tables[table1].mutex);
-    std::shared_lock<std::shared_mutex> lockTable2(m_tables[table2].mutex);
-    
-    Table *tab1 = m_tables[table1].table;
-    Table *tab2 = m_tables[table2].table;
+    bool firstIndexed = tab1->hasIndex(col1);
 
-    std::size_t col1 = tab1->schema().indexOf(column1);
-    std::size_t col2 = tab2->schema().indexOf(column2);
+    const Table::Snapshot *scanned = firstIndexed ? tab2 : tab1;
+    const Table::Snapshot *indexed = firstIndexed ? tab1 : tab2;
+    std::size_t scannedCol = firstIndexed ? col2 : col1;
+    std::size_t indexedCol = firstIndexed ? col1 : col2;
 
-    sql::DataType type = tab1->schema().typeOf(col1);
+    auto index = indexed->index<T>(indexedCol);
 
-    std::vector<std::pair<Table::RowID, Table::RowID>> rowPairs;
-    switch (type)
+    std::set<T> matched;
+    std::vector<Table::RowID> scannedRows;
+    for (auto row : *scanned) 
     {
-    case sql::DataType::INTEGER:
-        if (tab1->hasIndex(col1) && tab2->hasIndex(col2)) {
-            rowPairs = findNonPairedRowsByIndex<long>(tab1, tab2, col1, col2);
+        if (row.isNull(scannedCol)) {
+            continue;
         }
+        // A key the filter rules out needs no lookup to be unmatched.
+        const T& value = row.cast<T>(scannedCol);
+        if (!index->mayContain(value) || index->find(value) == index->end()) {
+            scannedRows.push_back(row.id());
+        } 
         else {
-            rowPairs = findNonPairedRowsOnColumn<long>(tab1, tab2, col1, col2);
+            matched.insert(value);
         }
-        break;
+    }
 
-    case sql::DataType::TEXT:
-        if (tab1->hasIndex(col1) && tab2->hasIndex(col2)) {
-            rowPairs = findNonPairedRowsByIndex<std::string>(tab1, tab2, 
-                                                             col1, col2);
+    std::vector<Table::RowID> indexedRows;
+    for (auto row : *indexed) 
+    {
+        if (row.isNull(indexedCol)) {
+            continue;
         }
-        else {
-            rowPairs = findNonPairedRowsOnColumn<std::string>(tab1, tab2,
-                                                              col1, col2);
+        if (matched.find(row.cast<T>(indexedCol)) == matched.end()) {
+            indexedRows.push_back(row.id());
         }
-        break;
     }
 
-    std::vector<Table::RowID> rows1;
-    std::vector<Table::RowID> rows2;
+    const auto& rows1 = firstIndexed ? indexedRows : scannedRows;
+    const auto& rows2 = firstIndexed ? scannedRows : indexedRows;
 
-    for (auto pair : rowPairs) {
-        rows1.push_back(pair.first);
-        rows2.push_back(pair.second);
+    std::vector<std::pair<Table::RowID, Table::RowID>> ids;
+    ids.reserve(rows1.size() + rows2.size());
+    for (Table::RowID id1 : rows1) {
+        ids.emplace_back(id1, std::size_t(-1));
+    }
+    for (Table::RowID id2 : rows2) {
+        ids.emplace_back(std::size_t(-1), id2);
     }
+    return ids;
+}
+
+
+template<typename T>
+std::vector<std::pair<Table::RowID, Table::RowID>>
+findNonPairedRows(const Table::Snapshot* tab1, const Table::Snapshot* tab2,
+                  std::size_t col1, std::size_t col2,
+                  ThreadPool& pool, TableLocks& locks, JoinMethod& method)
+{
+    using Access = JoinMethod::Access;
 
-    Selection::Info selectionInfo;
+    bool index1 = tab1->hasIndex(col1), index2 = tab2->hasIndex(col2);
+    bool parallel = pool.size() > 1 && 
+                    tab1->size() + tab2->size() >= radix::MIN_ROWS;
+    bool codes = std::is_same<T, std::string>::value && 
+                 tab1->encoded(col1) && tab2->encoded(col2);
 
-    selectionInfo.tables = {tab1, tab2};
-    selectionInfo.rows   = {rows1, rows2};
+    if (index1 && index2) {
+        method.set("index merge", Access::INDEX, Access::INDEX);
+    }
+    else if (index1 || index2) {
+        method.set("index lookup", index1 ? Access::INDEX : Access::SCAN,
+                   index2 ? Access::INDEX : Access::SCAN);
+    }
+    else {
+        method.set(std::string(parallel ? "radix hash anti-join" 
+                                        : "hash anti-join") + 
+                   (codes ? " on codes" : ""), 
+                   Access::SCAN, Access::SCAN);
+    }
+    if (!method.run) {
+        return {};
+    }
 
-    for (const ColumnInfo& column : tab1->schema()) 
-    {
-        Selection::Info::Column selcol;
-        selcol.name = table1 + "." + column.name();
-        selcol.type = column.type();
-        selcol.tableIndex = 0;
-        selcol.tableColumnIndex = tab1->schema().indexOf(column.name());
-        selectionInfo.columns.push_back(selcol);
+    if (index1 && index2) {
+        return findNonPairedRowsByIndex<T>(tab1, tab2, col1, col2);
     }
 
-    for (const ColumnInfo& column : tab2->schema()) 
+    if (index1 || index2) {
+        return findNonPairedRowsByLookup<T>(tab1, tab2, col1, col2);
+    }
+
+    // The rest only reads the snapshots, so writers may go on.
+    locks.clear();
+
+    if constexpr (std::is_same<T, std::string>::value) 
     {
-        Selection::Info::Column selcol;
-        selcol.name = table2 + "." + column.name();
-        selcol.type = column.type();
-        selcol.tableIndex = 1;
-        selcol.tableColumnIndex = tab2->schema().indexOf(column.name());
-        selectionInfo.columns.push_back(selcol);
+        if (codes && parallel) {
+            return radix::findNonPairedRows<Table::Code>(tab1, tab2, 
+                                                         col1, col2, pool);
+        }
+        if (codes) {
+            return findNonPairedRowsByHash<Table::Code>(tab1, tab2, col1, col2);
+        }
+    }
+
+    if (parallel) {
+        return radix::findNonPairedRows<T>(tab1, tab2, col1, col2, pool);
     }
 
-    return new Selection(selectionInfo);
+    return findNonPairedRowsByHash<T>(tab1, tab2, col1, col2);
+}
+
+
+SelectionPtr Memstore::getFullOuterJoin(const TableHandle& table1,  
+                                        const TableHandle& table2, 
+                                        std::string_view column1, 
+                                        std::string_view column2,
+                                        const std::pmr::vector<std::string_view>& columns,
+                                        Profile* profile,
+                                        std::pmr::memory_resource* memory)
+{
+    return join(table1, table2, column1, column2, columns, profile, memory,
+        [this](const Table::Snapshot* tab1, const Table::Snapshot* tab2,
+               std::size_t col1, std::size_t col2, TableLocks& locks,
+               JoinMethod& method)
+        {
+            std::vector<std::pair<Table::RowID, Table::RowID>> rowPairs;
+            switch (tab1->schema().typeOf(col1))
+            {
+            case sql::DataType::INTEGER:
+                rowPairs = findNonPairedRows<long>(tab1, tab2, col1, col2, 
+                                                   m_joinPool, locks, method);
+                break;
+
+            case sql::DataType::TEXT:
+                rowPairs = findNonPairedRows<std::string>(tab1, tab2, col1, col2,
+                                                          m_joinPool, locks,
+                                                          method);
+                break;
+            }
+            return rowPairs;
+        });
 }
 
 #endif // STORAGE_H
@@ -35,7 +35,7 @@ std::size_t Schema::primaryKeyIndex() const
 }
 
 
-bool Schema::contains(const std::string& columnName) const
+bool Schema::contains(std::string_view columnName) const
 {
     for (const ColumnInfo& column : m_columns) {
         if (column.name() == columnName) {
@@ -46,14 +46,15 @@ bool Schema::contains(const std::string& columnName) const
 }
 
 
-std::size_t Schema::indexOf(const std::string& columnName) const
+std::size_t Schema::indexOf(std::string_view columnName) const
 {
     for (std::size_t i = 0; i < m_columns.size(); ++i) {
         if (m_columns[i].name() == columnName) {
             return i;
         }
     }
-    throw sql::Exception("Schema: column '" + columnName + "' does not exist");
+    throw sql::Exception("Schema: column '" + std::string(columnName) + 
+                         "' does not exist");
 }
 
 
@@ -71,54 +72,130 @@ sql::DataType Schema::typeOf(const std::string& columnName) const
 
 
 
-Table::Table(const Schema& s) : m_schema(s) 
+Table::Table(const Schema& s, std::shared_ptr<memory::Counter> memory,
+             std::shared_ptr<Dictionary> dictionary) 
+    : m_schema(s), m_store(std::make_shared<Store>(memory, 
+                                        std::vector<char>(m_schema.size()))), 
+      m_stats(m_schema.size()), 
+      m_statsCharge(memory, m_stats.size() * sizeof(ColumnStats)),
+      m_memory(std::move(memory)), m_dictionary(std::move(dictionary))
 {
+    for (std::size_t i = 0; i < m_schema.size(); ++i) {
+        m_store->encoded[i] = m_dictionary && m_schema[i].isDictionary();
+    }
+
     m_indices.reserve(m_schema.size());
     for (std::size_t i = 0; i < m_schema.size(); ++i) {
         m_indices.push_back(nullptr);
     }
 
-    switch (m_schema.typeOf(m_schema.primaryKeyIndex())) 
+    std::size_t pkey = m_schema.primaryKeyIndex();
+    m_indices[pkey] = makeIndex(m_schema.typeOf(pkey));
+}
+
+
+Table::Table(Schema&& s, std::shared_ptr<memory::Counter> memory,
+             std::shared_ptr<Dictionary> dictionary) 
+    : m_schema(std::move(s)), m_store(std::make_shared<Store>(memory, 
+                                        std::vector<char>(m_schema.size()))), 
+      m_stats(m_schema.size()), 
+      m_statsCharge(memory, m_stats.size() * sizeof(ColumnStats)),
+      m_memory(std::move(memory)), m_dictionary(std::move(dictionary))
+{
+    for (std::size_t i = 0; i < m_schema.size(); ++i) {
+        m_store->encoded[i] = m_dictionary && m_schema[i].isDictionary();
+    }
+
+    m_indices.reserve(m_schema.size());
+    for (std::size_t i = 0; i < m_schema.size(); ++i) {
+        m_indices.push_back(nullptr);
+    }
+
+    std::size_t pkey = m_schema.primaryKeyIndex();
+    m_indices[pkey] = makeIndex(m_schema.typeOf(pkey));
+}
+
+
+Table::~Table()
+{
+    for (AbstractIndex* index : m_indices) {
+        if (index) delete index;
+    }
+}
+
+
+bool Table::hasIndex(std::size_t col) const { 
+    return col < m_indices.size() && m_indices[col] != nullptr; 
+}
+
+
+void Table::createIndex(std::size_t col)
+{
+    if (hasIndex(col)) {
+        throw sql::Exception("index on column " + m_schema[col].name() + 
+                             " already exists");
+    }
+
+    m_indices[col] = makeIndex(m_schema.typeOf(col));
+    for (RowID row = 0; row < m_store->size(); ++row) {
+        if ((*m_store)[row].removed == 0) indexRow(col, row);
+    }
+}
+
+
+Table::AbstractIndex* Table::makeIndex(sql::DataType type) const
+{
+    switch (type) 
     {
     case sql::DataType::INTEGER:
-        m_indices[m_schema.primaryKeyIndex()] = new Index<long>();
-        break;
+        return new Index<long>(m_memory);
     case sql::DataType::TEXT:
-        m_indices[m_schema.primaryKeyIndex()] = new Index<std::string>();
-        break;
+        return new Index<std::string>(m_memory);
+    default:
+        throw sql::Exception("Table: unsupported index type");
     }
 }
 
 
-Table::Table(Schema&& s) : m_schema(std::move(s)) 
+void Table::indexRow(std::size_t col, RowID row)
 {
-    m_indices.reserve(m_schema.size());
-    for (std::size_t i = 0; i < m_schema.size(); ++i) {
-        m_indices.push_back(nullptr);
+    const Cell& cell = (*m_store)[row].cells[col];
+    if (cell.isNull()) {
+        return;
     }
 
-    switch (m_schema.typeOf(m_schema.primaryKeyIndex())) 
+    switch (m_schema.typeOf(col)) 
     {
     case sql::DataType::INTEGER:
-        m_indices[m_schema.primaryKeyIndex()] = new Index<long>();
+        static_cast<Index<long>*>(m_indices[col])->insert(cell.getLong(), row);
         break;
+
     case sql::DataType::TEXT:
-        m_indices[m_schema.primaryKeyIndex()] = new Index<std::string>();
+        static_cast<Index<std::string>*>(m_indices[col])->insert(
+                                                    cell.getString(), row);
         break;
     }
 }
 
 
-Table::~Table()
+void Table::unindexRow(std::size_t col, RowID row)
 {
-    for (AbstractIndex* index : m_indices) {
-        if (index) delete index;
+    const Cell& cell = (*m_store)[row].cells[col];
+    if (cell.isNull()) {
+        return;
     }
-}
 
+    switch (m_schema.typeOf(col)) 
+    {
+    case sql::DataType::INTEGER:
+        static_cast<Index<long>*>(m_indices[col])->remove(cell.getLong(), row);
+        break;
 
-bool Table::hasIndex(std::size_t col) const { 
-    return m_schema.primaryKeyIndex() == col; 
+    case sql::DataType::TEXT:
+        static_cast<Index<std::string>*>(m_indices[col])->remove(
+                                                    cell.getString(), row);
+        break;
+    }
 }
 
 
@@ -144,20 +221,16 @@ bool Table::isUnique(const std::vector<DataObject>& values) const
     switch (m_schema[i].type())
     {
     case sql::DataType::INTEGER:
-        for (auto& row : m_rows) {
-            if (row[i].getLong() == values[i].getLong()) {
-                return false;
-            }
-        }   
-        break;
+        {
+            auto pkeyIndex = index<long>(i);
+            return pkeyIndex->find(values[i].getLong()) == pkeyIndex->end();
+        }
 
     case sql::DataType::TEXT:
-        for (auto& row : m_rows) {
-            if (row[i].getString() == values[i].getString()) {
-                return false;
-            }
-        }   
-        break;
+        {
+            auto pkeyIndex = index<std::string>(i);
+            return pkeyIndex->find(values[i].getString()) == pkeyIndex->end();
+        }
     }
     return true;
 }
@@ -173,81 +246,464 @@ Table::RowID Table::insert(Record&& values)
         throw sql::Exception("duplicate");
     }
     
+    RowID rowID = append(std::move(values));
+
+    for (std::size_t col = 0; col < m_indices.size(); ++col) {
+        if (m_indices[col]) indexRow(col, rowID);
+    }
+
+    return rowID;
+}
+
+
+Table::RowID Table::append(Record&& values)
+{
+    if (!isSatisfySchema(values)) {
+        throw sql::Exception("Table: mismatch schema");
+    }
+
     std::vector<Cell> row;
     row.resize(values.size());
 
-    for (std::size_t i = 0; i < values.size(); ++i) {
-        row[i] = values[i];
+    for (std::size_t i = 0; i < values.size(); ++i) 
+    {
+        m_stats[i].add(values[i]);
+        if (values[i].isNull()) {
+            continue;
+        }
+        if (m_store->encoded[i]) {
+            row[i].intern(m_dictionary->intern(values[i].getString()));
+        }
+        else {
+            row[i] = std::move(values[i]);
+        }
     }
 
-    m_rows.push_back(std::move(row));
-    std::size_t rowID =  m_rows.size() - 1;
+    ++m_writes;
+    return pushRow(std::move(row));
+}
 
-    std::size_t pkey = m_schema.primaryKeyIndex();
-    switch (m_schema.typeOf(pkey)) 
+
+Table::RowID Table::pushRow(std::vector<Cell>&& cells)
+{
+    std::size_t bytes = cells.capacity() * sizeof(Cell);
+    for (std::size_t col = 0; col < cells.size(); ++col) {
+        bytes += cells[col].footprint(m_schema.typeOf(col));
+    }
+
+    RowID rowID = m_store->size();
+    std::size_t capacity = m_store->capacity();
+    m_store->push_back(StoredRow(std::move(cells)));
+    m_store->charge.add(bytes + 
+                        (m_store->capacity() - capacity) * sizeof(StoredRow));
+    return rowID;
+}
+
+
+std::size_t Table::footprint(const Record& values) const
+{
+    std::size_t bytes = sizeof(StoredRow) + values.size() * sizeof(Cell);
+    for (std::size_t col = 0; col < values.size(); ++col) 
     {
-    case sql::DataType::INTEGER:
-        {
-            Index<long> *pLongIndex = static_cast<Index<long>*>(m_indices[pkey]);
-            pLongIndex->insert(m_rows[rowID][pkey].getLong(), rowID);
+        const DataObject& value = values[col];
+        bytes += m_store->encoded[col] && !value.isNull()
+                    ? m_dictionary->footprint(value.getString())
+                    : Cell::footprint(value);
+        if (value.isNull() || !hasIndex(col)) {
+            continue;
         }
-        break;
+        if (value.type() == sql::DataType::INTEGER) {
+            bytes += Index<long>::entryBytes(value.getLong());
+        }
+        else {
+            bytes += Index<std::string>::entryBytes(value.getString());
+        }
+    }
+    return bytes;
+}
 
-    case sql::DataType::TEXT:
-        {
-            Index<std::string> *pStringIndex = 
-                static_cast<Index<std::string>*>(m_indices[pkey]);
-            pStringIndex->insert(m_rows[rowID][pkey].getString(), rowID);
+
+std::size_t Table::growth() const
+{
+    std::size_t bytes = m_store->growth() * sizeof(StoredRow);
+    for (std::size_t col = 0; col < m_indices.size(); ++col) 
+    {
+        if (!m_indices[col]) {
+            continue;
+        }
+        if (m_schema.typeOf(col) == sql::DataType::INTEGER) {
+            bytes += index<long>(col)->growth();
+        }
+        else {
+            bytes += index<std::string>(col)->growth();
         }
-        break;
     }
+    return bytes;
+}
 
-    return rowID;
+
+Table::Usage Table::usage() const
+{
+    Usage usage;
+    usage.rows = m_store->charge.bytes();
+    usage.stats = m_statsCharge.bytes();
+    for (const AbstractIndex* index : m_indices) {
+        if (index) usage.indices += index->charge.bytes();
+    }
+    return usage;
 }
 
 
-void Table::truncate()
+void Table::buildIndex(std::size_t col, const std::vector<RowID>& sorted)
 {
-    m_rows.clear();
-    for (AbstractIndex* index : m_indices) {
-        if (index) index->clear();
+    AbstractIndex* index = makeIndex(m_schema.typeOf(col));
+    if (m_indices[col]) delete m_indices[col];
+    m_indices[col] = index;
+
+    for (RowID row : sorted) 
+    {
+        const Cell& cell = (*m_store)[row].cells[col];
+        if (cell.isNull()) {
+            continue;
+        }
+        switch (m_schema.typeOf(col))
+        {
+        case sql::DataType::INTEGER:
+            static_cast<Index<long>*>(index)->appendSorted(cell.getLong(), row);
+            break;
+
+        case sql::DataType::TEXT:
+            static_cast<Index<std::string>*>(index)->appendSorted(
+                                                    cell.getString(), row);
+            break;
+        }
     }
+    ++m_writes;
 }
 
-Record Table::makeRecord(RowID row) const
+
+void Table::validate(const std::vector<Record>& rows) const
 {
-    Record record;
-    record.reserve(m_schema.size());
+    std::size_t pkey = m_schema.primaryKeyIndex();
+    for (const Record& row : rows) 
+    {
+        if (!isSatisfySchema(row)) {
+            throw sql::Exception("Table: mismatch schema");
+        }
+        if (row[pkey].isNull()) {
+            throw sql::Exception("primary key is NULL");
+        }
+        if (!isUnique(row)) {
+            throw sql::Exception("duplicate");
+        }
+    }
 
-    if (row == std::size_t(-1)) {
-        for (const ColumnInfo& col : m_schema) {
-            record.emplace_back(DataObject(col.type()));
+    // Repeats among the new rows themselves.
+    std::vector<const DataObject*> keys;
+    keys.reserve(rows.size());
+    for (const Record& row : rows) {
+        keys.push_back(&row[pkey]);
+    }
+
+    auto less = [](const DataObject* a, const DataObject* b) {
+        return a->type() == sql::DataType::INTEGER 
+                ? a->getLong() < b->getLong() 
+                : a->getString() < b->getString();
+    };
+    std::sort(keys.begin(), keys.end(), less);
+    for (std::size_t i = 1; i < keys.size(); ++i) {
+        if (!less(keys[i - 1], keys[i])) {
+            throw sql::Exception("duplicate");
         }
-        return record;
     }
+}
 
 
+void Table::insertAll(std::vector<Record>&& rows)
+{
+    RowID first = m_store->size();
+    for (Record& row : rows) {
+        append(std::move(row));
+    }
+
+    for (std::size_t col = 0; col < m_indices.size(); ++col) 
+    {
+        if (!m_indices[col]) {
+            continue;
+        }
+        if (first == 0) {
+            buildIndex(col, keyOrder(col));
+            continue;
+        }
+        for (RowID row = first; row < m_store->size(); ++row) {
+            indexRow(col, row);
+        }
+    }
+}
+
+
+std::vector<Table::RowID> Table::keyOrder(std::size_t col) const
+{
+    std::vector<RowID> rows;
+    rows.reserve(m_store->size());
+    for (RowID row = 0; row < m_store->size(); ++row) 
+    {
+        const StoredRow& stored = (*m_store)[row];
+        if (stored.removed == 0 && !stored.cells[col].isNull()) {
+            rows.push_back(row);
+        }
+    }
+
+    auto cell = [this, col](RowID row) -> const Cell& { 
+        return (*m_store)[row].cells[col]; 
+    };
+    if (m_schema.typeOf(col) == sql::DataType::INTEGER) {
+        std::stable_sort(rows.begin(), rows.end(), [&](RowID a, RowID b) {
+            return cell(a).getLong() < cell(b).getLong();
+        });
+    }
+    else {
+        std::stable_sort(rows.begin(), rows.end(), [&](RowID a, RowID b) {
+            return cell(a).getString() < cell(b).getString();
+        });
+    }
+    return rows;
+}
+
+
+std::unique_ptr<Table::Retired> Table::truncate()
+{
+    // Columns encoded by compaction start over as plain strings.
+    std::vector<char> encoded(m_schema.size());
     for (std::size_t i = 0; i < m_schema.size(); ++i) {
-        record.emplace_back(m_rows[row][i].toDataObject(m_schema[i].type()));
+        encoded[i] = m_dictionary && m_schema[i].isDictionary();
+    }
+
+    auto retired = std::make_unique<Retired>();
+    retired->store = std::atomic_exchange(&m_store,
+                        std::make_shared<Store>(m_memory, std::move(encoded)));
+
+    for (std::size_t col = 0; col < m_indices.size(); ++col) 
+    {
+        if (m_indices[col]) {
+            retired->indices.push_back(m_indices[col]);
+            m_indices[col] = makeIndex(m_schema.typeOf(col));
+        }
     }
-    return record;
+
+    m_stats.assign(m_schema.size(), ColumnStats());
+    m_epoch = 0;
+    m_tombstones = 0;
+    ++m_writes;
+    return retired;
 }
 
 
-std::vector<Record> Table::select(const std::vector<RowID>& rows) const
+Table::Retired::~Retired()
 {
-    std::vector<Record> records;
-    records.reserve(rows.size());
+    for (AbstractIndex* index : indices) {
+        delete index;
+    }
+}
+
+
+void Table::remove(RowID row)
+{
+    StoredRow& stored = (*m_store)[row];
+    if (stored.removed != 0) {
+        return;
+    }
+
+    for (std::size_t col = 0; col < m_indices.size(); ++col) 
+    {
+        if (m_indices[col]) unindexRow(col, row);
+        m_stats[col].remove(stored.cells[col].isNull());
+    }
+
+    stored.removed.store(++m_epoch, std::memory_order_release);
+    ++m_tombstones;
+    ++m_writes;
+}
+
+
+std::size_t Table::removeWhere(std::size_t col, const DataObject& value)
+{
+    if (value.isNull() || value.type() != m_schema.typeOf(col)) {
+        return 0;
+    }
+
+    std::vector<RowID> rows;
+    if (hasIndex(col)) 
+    {
+        switch (value.type())
+        {
+        case sql::DataType::INTEGER:
+            {
+                auto idx = index<long>(col);
+                auto found = idx->find(value.getLong());
+                if (found != idx->end()) rows = idx->rows(value.getLong());
+            }
+            break;
+
+        case sql::DataType::TEXT:
+            {
+                auto idx = index<std::string>(col);
+                auto found = idx->find(value.getString());
+                if (found != idx->end()) rows = idx->rows(value.getString());
+            }
+            break;
+        }
+    }
+    else
+    {
+        // An encoded column compares codes, and cannot hold a string the
+        // dictionary does not know.
+        bool encoded = m_store->encoded[col];
+        Code code = 0;
+        if (encoded)
+        {
+            const Cell::Interned* entry = m_dictionary->find(value.getString());
+            if (!entry) {
+                return 0;
+            }
+            code = entry->code;
+        }
+        for (RowID row = 0; row < m_store->size(); ++row)
+        {
+            const StoredRow& stored = (*m_store)[row];
+            const Cell& cell = stored.cells[col];
+            if (stored.removed != 0 || cell.isNull()) {
+                continue;
+            }
+            bool equal = encoded ? cell.cast<Code>() == code
+                       : value.type() == sql::DataType::INTEGER
+                            ? cell.getLong() == value.getLong()
+                            : cell.getString() == value.getString();
+            if (equal) rows.push_back(row);
+        }
+    }
+
     for (RowID row : rows) {
-        records.push_back(makeRecord(row));
+        remove(row);
+    }
+    return rows.size();
+}
+
+
+std::unique_ptr<Table> Table::compacted() const
+{
+    auto table = std::make_unique<Table>(m_schema, m_memory, m_dictionary);
+    for (std::size_t col = 0; col < m_indices.size(); ++col)
+    {
+        if (m_indices[col] && !table->hasIndex(col)) table->createIndex(col);
+        if (shouldEncode(col)) table->m_store->encoded[col] = true;
+    }
+    const std::vector<char>& encoded = table->m_store->encoded;
+
+    for (RowID row = 0; row < m_store->size(); ++row) 
+    {
+        const StoredRow& stored = (*m_store)[row];
+        if (stored.removed != 0) {
+            continue;
+        }
+
+        std::vector<Cell> cells(m_schema.size());
+        for (std::size_t col = 0; col < cells.size(); ++col) 
+        {
+            DataObject value = stored.cells[col].toDataObject(
+                                                    m_schema.typeOf(col));
+            table->m_stats[col].add(value);
+            if (value.isNull()) {
+                continue;
+            }
+            if (encoded[col]) {
+                cells[col].intern(m_dictionary->intern(value.getString()));
+            }
+            else {
+                cells[col] = std::move(value);
+            }
+        }
+
+        RowID copy = table->pushRow(std::move(cells));
+        for (std::size_t col = 0; col < m_indices.size(); ++col) {
+            if (m_indices[col]) table->indexRow(col, copy);
+        }
+    }
+
+    table->m_writes = m_writes;
+    return table;
+}
+
+
+std::unique_ptr<Table::Retired> Table::install(std::unique_ptr<Table>&& compacted)
+{
+    if (compacted->m_writes != m_writes) {
+        return nullptr;
+    }
+
+    auto retired = std::make_unique<Retired>();
+    retired->store = std::atomic_exchange(&m_store, compacted->m_store);
+    for (AbstractIndex*& index : m_indices) 
+    {
+        if (index) retired->indices.push_back(index);
+        index = nullptr;
+    }
+    std::swap(m_indices, compacted->m_indices);
+    std::swap(m_stats, compacted->m_stats);
+    m_epoch = 0;
+    m_tombstones = 0;
+    ++m_writes;
+    return retired;
+}
+
+
+bool Table::shouldEncode(std::size_t col) const
+{
+    const ColumnStats& stats = m_stats[col];
+    return m_dictionary && !m_store->encoded[col] &&
+           m_schema.typeOf(col) == sql::DataType::TEXT &&
+           stats.values() >= ENCODE_MIN_VALUES &&
+           stats.distinctCount() * ENCODE_MIN_REPEATS <= stats.values();
+}
+
+
+bool Table::wantsEncoding() const
+{
+    for (std::size_t col = 0; col < m_schema.size(); ++col) {
+        if (shouldEncode(col)) return true;
     }
-    return records;
+    return false;
+}
+
+
+Table::Snapshot Table::snapshot(std::pmr::memory_resource* memory) const
+{
+    return Snapshot(this, std::atomic_load(&m_store), m_epoch, memory);
+}
+
+
+Table::Snapshot Table::Snapshot::concat(std::pmr::vector<Snapshot>&& shards)
+{
+    if (shards.size() == 1) {
+        return std::move(shards[0]);
+    }
+
+    Snapshot result(shards.get_allocator().resource());
+    result.m_parts.reserve(shards.size());
+    for (Snapshot& shard : shards) 
+    {
+        Part part = std::move(shard.m_parts[0]);
+        part.first = result.m_size;
+        result.m_size += shard.m_size;
+        result.m_parts.push_back(std::move(part));
+    }
+    return result;
 }
 
 
 Table::Cell& Table::Cell::operator= (Cell&& other)
 {
-    if (m_holder) delete m_holder;
+    release();
     m_holder = other.m_holder;
     other.m_holder = nullptr;
     return *this;
@@ -262,16 +718,18 @@ Table::Cell& Table::Cell::operator= (long n)
 }
 
 
-Table::Cell& Table::Cell::operator= (const std::string& s) 
+Table::Cell& Table::Cell::operator= (const std::string& s)
 {
+    if (isInterned()) release();
     if (m_holder) this->cast<std::string>() = s;
     else m_holder = new Holder<std::string>(s);
     return *this;
 }
 
 
-Table::Cell& Table::Cell::operator= (std::string&& s) 
-{ 
+Table::Cell& Table::Cell::operator= (std::string&& s)
+{
+    if (isInterned()) release();
     if (m_holder) this->cast<std::string>() = std::move(s);
     else m_holder = new Holder<std::string>(std::move(s));
     return *this;
@@ -294,6 +752,46 @@ Table::Cell& Table::Cell::operator= (const DataObject& d)
 }
 
 
+Table::Cell& Table::Cell::operator= (DataObject&& d)
+{
+    switch (d.type())
+    {
+    case sql::DataType::INTEGER:
+        *this = d.getLong();
+        break;
+
+    case sql::DataType::TEXT:
+        *this = d.releaseString();
+        break;
+    }
+    return *this;
+}
+
+
+std::size_t Table::Cell::footprint(sql::DataType type) const
+{
+    if (isNull() || isInterned()) {
+        return 0;
+    }
+    if (type == sql::DataType::INTEGER) {
+        return sizeof(Holder<long>);
+    }
+    return sizeof(Holder<std::string>) + memory::heapBytes(getString());
+}
+
+
+std::size_t Table::Cell::footprint(const DataObject& value)
+{
+    if (value.isNull()) {
+        return 0;
+    }
+    if (value.type() == sql::DataType::INTEGER) {
+        return sizeof(Holder<long>);
+    }
+    return sizeof(Holder<std::string>) + memory::heapBytes(value.getString());
+}
+
+
 DataObject Table::Cell::toDataObject(sql::DataType type) const
 {
     if (this->isNull()) return DataObject(type);
@@ -307,4 +805,82 @@ DataObject Table::Cell::toDataObject(sql::DataType type) const
     default:
         throw sql::Exception("Cell: unsupported type");
     } 
-}
\ No newline at end of file
+}
+
+
+// The reference is taken under the lock, so sweep() cannot drop an entry
+// between its lookup and the cell that is to hold it.
+const Table::Cell::Interned* Table::Dictionary::intern(const std::string& value)
+{
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        auto found = m_map.find(value);
+        if (found != m_map.end()) {
+            found->second->refs.fetch_add(1, std::memory_order_relaxed);
+            return found->second.get();
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    auto found = m_map.find(value);
+    if (found != m_map.end()) {
+        found->second->refs.fetch_add(1, std::memory_order_relaxed);
+        return found->second.get();
+    }
+
+    Code code;
+    if (!m_free.empty()) 
+    {
+        code = m_free.back();
+        m_free.pop_back();
+    }
+    else if (m_map.size() >= std::numeric_limits<Code>::max()) {
+        throw sql::Exception("dictionary is full");
+    }
+    else {
+        code = Code(m_map.size());
+    }
+
+    auto entry = std::make_unique<Entry>(value, code);
+    entry->refs = 1;
+    const Entry* result = entry.get();
+    m_map.emplace(result->value, std::move(entry));
+    m_charge.add(entryBytes(value));
+    return result;
+}
+
+
+const Table::Cell::Interned* Table::Dictionary::find(
+                                            const std::string& value) const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    auto found = m_map.find(value);
+    return found != m_map.end() ? found->second.get() : nullptr;
+}
+
+
+std::size_t Table::Dictionary::sweep()
+{
+    std::unique_lock<std::shared_mutex> lock(m_mutex);
+    std::size_t dropped = 0;
+    for (auto it = m_map.begin(); it != m_map.end(); )
+    {
+        const Entry& entry = *it->second;
+        if (entry.refs.load(std::memory_order_acquire) != 0) {
+            ++it;
+            continue;
+        }
+        m_free.push_back(entry.code);
+        m_charge.sub(entryBytes(entry.value));
+        it = m_map.erase(it);
+        ++dropped;
+    }
+    return dropped;
+}
+
+
+std::size_t Table::Dictionary::size() const
+{
+    std::shared_lock<std::shared_mutex> lock(m_mutex);
+    return m_map.size();
+}
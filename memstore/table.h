@@ -1,24 +1,46 @@
 #ifndef TABLE_H
 #define TABLE_H
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+#include <limits>
 #include <vector>
 #include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <set>
+#include <shared_mutex>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
 #include "data_object.h"
+#include "append_only_vector.h"
+#include "memory.h"
+#include "bloom_filter.h"
+#include "stats.h"
 
 class ColumnInfo 
 {
     std::string   m_name;
     sql::DataType m_type;
     bool          m_pkey;
+    bool          m_dictionary;
 
 public:
-    ColumnInfo(const std::string& name, sql::DataType t, bool primaryKey) 
-        : m_name(name), m_type(t), m_pkey(primaryKey) {}
+    ColumnInfo(const std::string& name, sql::DataType t, bool primaryKey,
+               bool dictionary = false) 
+        : m_name(name), m_type(t), m_pkey(primaryKey), 
+          m_dictionary(dictionary) {}
 
     sql::DataType type() const      { return m_type; }
     const std::string& name() const { return m_name; }
     bool isPrimaryKey() const       { return m_pkey; }
+
+    // TEXT values kept as codes of the database's dictionary.
+    bool isDictionary() const       { return m_dictionary; }
 };
 
 
@@ -31,8 +53,8 @@ public:
 
     std::size_t addColumn(const ColumnInfo& ci);
 
-    bool contains(const std::string& columnName) const;
-    std::size_t indexOf(const std::string& columnName) const;
+    bool contains(std::string_view columnName) const;
+    std::size_t indexOf(std::string_view columnName) const;
     std::size_t primaryKeyIndex() const;
 
     sql::DataType typeOf(std::size_t columnIndex) const;
@@ -57,44 +79,156 @@ private:
     class AbstractIndex;
 public:
     class Iterator;
+    class Snapshot;
+    class Dictionary;
+    struct Retired;
     template<typename T> class Index;
-    
+
+    using RowID = std::size_t;
+
+    // A string of a dictionary-encoded column, as its entry's number.
+    using Code = std::uint32_t;
+
 private:
+    struct StoredRow;
+    struct Store;
+
     Schema                         m_schema;
     std::vector<AbstractIndex*>    m_indices;
-    std::vector<std::vector<Cell>> m_rows;
+
+    // Replaced as a whole on truncate and compaction; readers holding a 
+    // snapshot keep the old rows alive until they are done with them.
+    std::shared_ptr<Store>         m_store;
+
+    // Bumped by every remove(). A snapshot still sees the rows removed
+    // after the epoch it was taken at.
+    std::uint64_t                  m_epoch = 0;
+    std::size_t                    m_tombstones = 0;
+
+    // Bumped by every write, so a compaction can tell it is out of date.
+    std::uint64_t                  m_writes = 0;
+
+    std::vector<ColumnStats>       m_stats;
+    memory::Charge                 m_statsCharge;
+
+    // Charged for new stores and indices; null when nobody counts.
+    std::shared_ptr<memory::Counter> m_memory;
+
+    // Strings of the encoded columns; without one nothing is encoded.
+    std::shared_ptr<Dictionary>    m_dictionary;
+
+    // Compaction encodes a TEXT column once it has this many values, and
+    // at least that many per distinct one.
+    static const std::size_t ENCODE_MIN_VALUES = 4096;
+    static const std::size_t ENCODE_MIN_REPEATS = 16;
 
 public:
-    explicit Table(const Schema& s);
-    explicit Table(Schema&& s);
+    // Rows and indices are charged to the counter, if there is one. 
+    // Columns declared DICTIONARY are encoded with the dictionary, if 
+    // there is one.
+    explicit Table(const Schema& s, 
+                   std::shared_ptr<memory::Counter> memory = nullptr,
+                   std::shared_ptr<Dictionary> dictionary = nullptr);
+    explicit Table(Schema&& s, 
+                   std::shared_ptr<memory::Counter> memory = nullptr,
+                   std::shared_ptr<Dictionary> dictionary = nullptr);
 
     ~Table();
 
+    Table(const Table&) = delete;
+    Table& operator= (const Table&) = delete;
+
     const Schema& schema() const noexcept { return m_schema; }
     bool hasIndex(std::size_t col) const;
+    void createIndex(std::size_t col);
 
     template<typename T>
     const Index<T>* index(std::size_t col) const { 
         return static_cast<Index<T>*>(m_indices[col]); 
     }
 
-    using RowID = std::size_t;
-
+    // Writers must hold the table exclusively, readers of the indices 
+    // must hold it shared. Snapshots need no lock at all.
     RowID insert(Record&& values);
     void  remove(RowID row);
-    void  truncate(); 
 
-    Row operator[] (RowID r) { return Row(this, r); }
-    std::vector<Record> select(const std::vector<RowID>& rows) const;
+    // Bulk loading. append() adds a row the caller has already checked
+    // for a duplicate key, and leaves the indices alone; buildIndex() 
+    // then replaces the index of a column with one built from the rows
+    // that have a value there, given in key order.
+    RowID append(Record&& values);
+    void  buildIndex(std::size_t col, const std::vector<RowID>& sorted);
+
+    // Many rows at once, in two steps so that the shards of a table can
+    // all be checked before any of them changes: validate() throws if a
+    // row does not match the schema or repeats a key, insertAll() adds
+    // validated rows. The indices of an empty table are built by sorting.
+    void validate(const std::vector<Record>& rows) const;
+    void insertAll(std::vector<Record>&& rows);
+
+    // Swaps in an empty store and empty indices; the old ones are handed
+    // back to be freed off the lock.
+    std::unique_ptr<Retired> truncate(); 
+
+    // Removes the rows with the value in the column, returns how many.
+    std::size_t removeWhere(std::size_t col, const DataObject& value);
+
+    // Removed rows still taking space in the store.
+    std::size_t tombstones() const noexcept { return m_tombstones; }
+
+    // Compaction in two steps, so only the second one blocks readers: 
+    // compacted() copies the live rows and their indices into a new table
+    // under a shared lock, install() takes them over under an exclusive 
+    // one and hands back the old ones, to be freed off the lock. It
+    // returns nullptr, leaving the table as it is, if the table was 
+    // written in between.
+    std::unique_ptr<Table> compacted() const;
+    std::unique_ptr<Retired> install(std::unique_ptr<Table>&& compacted);
+
+    // Whether the cells of the column hold dictionary codes, and whether
+    // the statistics show one that should: compaction then encodes it.
+    bool isEncoded(std::size_t col) const { return m_store->encoded[col]; }
+    bool wantsEncoding() const;
+
+    std::size_t size() const noexcept { return m_store->size(); }
+
+    // Bytes held by the current rows, the indices and the statistics.
+    struct Usage
+    {
+        std::size_t rows = 0;
+        std::size_t indices = 0;
+        std::size_t stats = 0;
+    };
+    Usage usage() const;
+
+    // Statistics of the column over the current rows. Like the indices,
+    // readers must hold the table shared.
+    const ColumnStats& stats(std::size_t col) const { return m_stats[col]; }
+
+    // Bytes a row of the values takes with its index entries, and the
+    // bytes the next insert allocates at once when an array is full.
+    std::size_t footprint(const Record& values) const;
+    std::size_t growth() const;
 
-    using iterator = Iterator;
-    iterator begin() { return !m_rows.empty() ? Iterator(this, 0) : end(); }
-    iterator end()   { return Iterator(this, -1); }
+    // The rows inserted so far. Later inserts and truncates do not change
+    // what a snapshot sees. Its list of parts is kept in `memory`.
+    Snapshot snapshot(std::pmr::memory_resource* memory = 
+                            std::pmr::get_default_resource()) const;
 
 private:
     bool isSatisfySchema(const std::vector<DataObject>& row) const;
+    bool shouldEncode(std::size_t col) const;
     bool isUnique(const std::vector<DataObject>& row) const;
-    Record makeRecord(RowID row) const;
+
+    AbstractIndex* makeIndex(sql::DataType type) const;
+
+    // Adds a row to the store and charges it.
+    RowID pushRow(std::vector<Cell>&& cells);
+
+    // Live rows with a value in the column, ordered by it and then by id.
+    std::vector<RowID> keyOrder(std::size_t col) const;
+    void indexRow(std::size_t col, RowID row);
+    void unindexRow(std::size_t col, RowID row);
 
 private:
     class Cell
@@ -111,15 +245,53 @@ private:
             explicit Holder(T&& t)      : value(std::move(t)) {}
         };
 
+    public:
+        // A string of the dictionary, shared by the cells holding it.
+        struct Interned : Holder<std::string>
+        {
+            Code code;
+
+            // Cells pointing here; Dictionary::sweep() drops the entry
+            // once there are none.
+            mutable std::atomic<std::size_t> refs{0};
+
+            Interned(const std::string& s, Code c) 
+                : Holder<std::string>(s), code(c) {}
+        };
+
+    private:
+        // The low bit marks an entry of the dictionary, which the cell
+        // does not own.
         AbstractHolder *m_holder;
 
+        AbstractHolder* holder() const {
+            return reinterpret_cast<AbstractHolder*>(
+                    reinterpret_cast<std::uintptr_t>(m_holder) & ~std::uintptr_t(1));
+        }
+
+        bool isInterned() const {
+            return reinterpret_cast<std::uintptr_t>(m_holder) & 1;
+        }
+
+        void release()
+        {
+            if (isInterned()) {
+                static_cast<Interned*>(holder())->refs.fetch_sub(
+                                            1, std::memory_order_release);
+            }
+            else {
+                delete m_holder;
+            }
+            m_holder = nullptr;
+        }
+
     public:
         Cell() : m_holder(nullptr) {}
         Cell(const Cell&) = delete;
         Cell(Cell&& other) 
             : m_holder(other.m_holder) { other.m_holder = nullptr; }
 
-        ~Cell() { if (m_holder) delete m_holder; }
+        ~Cell() { release(); }
 
         Cell& operator= (const Cell&) = delete;
         Cell& operator= (Cell&& c);
@@ -128,68 +300,257 @@ private:
         Cell& operator= (const std::string& s);
         Cell& operator= (std::string&& s);
         Cell& operator= (const DataObject& d);
+        Cell& operator= (DataObject&& d);
         
+        // Points the cell at an entry of the dictionary, taking over the
+        // reference Dictionary::intern() added for it.
+        void intern(const Interned* entry)
+        {
+            release();
+            m_holder = reinterpret_cast<AbstractHolder*>(
+                    reinterpret_cast<std::uintptr_t>(entry) | 1);
+        }
+
+        // Code only for cells of encoded columns.
         template<typename T>
-        T& cast() const {
-            return static_cast<Holder<T>*>(m_holder)->value;
+        T& cast() const 
+        {
+            if constexpr (std::is_same<T, Code>::value) {
+                return static_cast<Interned*>(holder())->code;
+            }
+            else {
+                return static_cast<Holder<T>*>(holder())->value;
+            }
         }
 
         bool isNull() const                  { return m_holder == nullptr; }
         long getLong() const                 { return cast<long>();        }
         const std::string& getString() const { return cast<std::string>(); }
         DataObject toDataObject(sql::DataType) const;
+
+        // Heap behind a cell of the type, or behind one holding the value.
+        std::size_t footprint(sql::DataType type) const;
+        static std::size_t footprint(const DataObject& value);
+    };
+
+
+    struct StoredRow
+    {
+        std::vector<Cell>          cells;
+
+        // Epoch of the remove() that deleted the row, 0 while it is live.
+        std::atomic<std::uint64_t> removed{0};
+
+        explicit StoredRow(std::vector<Cell>&& c) : cells(std::move(c)) {}
+        StoredRow(StoredRow&& other) 
+            : cells(std::move(other.cells)), removed(other.removed.load()) {}
+    };
+
+
+    // The rows and their charge, which goes when the last snapshot of
+    // them does.
+    struct Store : AppendOnlyVector<StoredRow>
+    {
+        memory::Charge     charge;
+
+        // Per column, whether its cells point into the dictionary.
+        std::vector<char>  encoded;
+
+        Store(std::shared_ptr<memory::Counter> memory, 
+              std::vector<char> encoded) 
+            : charge(std::move(memory)), encoded(std::move(encoded)) {}
     };
 
 
+    // A removed row reads as all NULLs, which every join skips.
     class Row
     {
-        Table* m_table;
-        RowID  m_row;
+        const std::vector<Cell>* m_cells;
+        RowID                    m_row;
+        bool                     m_live;
     public:
-        Row(Table* table, RowID row) : m_table(table), m_row(row) {}
+        Row(const std::vector<Cell>* cells, RowID row, bool live = true) 
+            : m_cells(cells), m_row(row), m_live(live) {}
 
         RowID id() const { return m_row; }
 
         bool isNull(int column) const { 
-            return m_table->m_rows[m_row][column].isNull(); 
+            return !m_live || (*m_cells)[column].isNull(); 
         }
 
         template<typename T>
-        T cast(int column) const {
-            return m_table->m_rows[m_row][column].cast<T>();
+        const T& cast(int column) const {
+            return (*m_cells)[column].cast<T>();
         }
 
         long getLong(int column) const {
-            return m_table->m_rows[m_row][column].getLong();
+            return (*m_cells)[column].getLong();
         }
 
-        const std::string& getString(int column) {
-            return m_table->m_rows[m_row][column].getString();
+        const std::string& getString(int column) const {
+            return (*m_cells)[column].getString();
         }
-
-        void update(int column, const DataObject& d);
-
-        void update(int column, long value);
-        void update(int column, const std::string& value);
-        void update(int column, std::string&& value);
     };
     
 
     class AbstractIndex 
     {
     public:
-        virtual void clear() = 0; 
+        // Readers rebuilding the cached keys charge them too.
+        mutable memory::Charge charge;
+
+        explicit AbstractIndex(std::shared_ptr<memory::Counter> memory)
+            : charge(std::move(memory)) {}
         virtual ~AbstractIndex() {}
     };
 
 
 public:
+    // Rows and indices taken out of a table. Destroying them may take a
+    // while for a big table.
+    struct Retired
+    {
+        std::shared_ptr<Store>       store;
+        std::vector<AbstractIndex*>  indices;
+
+        Retired() = default;
+        Retired(const Retired&) = delete;
+        Retired& operator= (const Retired&) = delete;
+        ~Retired();
+    };
+
+
+    // Rows of one table, or of the shards of a table laid end to end: 
+    // row ids of the second shard follow the last row of the first one.
+    class Snapshot
+    {
+        friend class Table;
+
+        struct Part
+        {
+            const Table*                 table;
+            std::shared_ptr<const Store> store;
+            RowID                        first;
+            std::uint64_t                epoch;
+        };
+
+        std::pmr::vector<Part> m_parts;
+        std::size_t            m_size;
+
+        Snapshot(const Table* table, std::shared_ptr<const Store> store,
+                 std::uint64_t epoch, std::pmr::memory_resource* memory)
+            : m_parts(memory), m_size(store->size()) 
+        {
+            m_parts.push_back({table, std::move(store), 0, epoch});
+        }
+
+        explicit Snapshot(std::pmr::memory_resource* memory) 
+            : m_parts(memory), m_size(0) {}
+
+        const Part& part(RowID row) const
+        {
+            if (m_parts.size() == 1) {
+                return m_parts[0];
+            }
+            auto part = std::upper_bound(m_parts.begin(), m_parts.end(), row,
+                            [](RowID r, const Part& p) { return r < p.first; });
+            return *--part;
+        }
+
+        const StoredRow& stored(RowID row) const 
+        {
+            const Part& p = part(row);
+            return (*p.store)[row - p.first];
+        }
+
+        const std::vector<Cell>& cells(RowID row) const { 
+            return stored(row).cells; 
+        }
+
+    public:
+        Snapshot() : m_size(0) {}
+
+        // The snapshots of the shards of a table end to end, in the 
+        // memory of their list.
+        static Snapshot concat(std::pmr::vector<Snapshot>&& shards);
+
+        // Rows removed before the snapshot was taken. Their ids stay in 
+        // the range of the snapshot.
+        bool isRemoved(RowID row) const
+        {
+            const Part& p = part(row);
+            if (p.epoch == 0) {
+                return false;
+            }
+            std::uint64_t removed = (*p.store)[row - p.first].removed.load(
+                                                    std::memory_order_acquire);
+            return removed != 0 && removed <= p.epoch;
+        }
+
+        const Schema& schema() const noexcept { 
+            return m_parts[0].table->schema(); 
+        }
+        std::size_t size() const noexcept { return m_size; }
+
+        bool isNull(RowID row, std::size_t col) const { 
+            return isRemoved(row) || cells(row)[col].isNull(); 
+        }
+        long getLong(RowID row, std::size_t col) const { 
+            return cells(row)[col].getLong(); 
+        }
+        const std::string& getString(RowID row, std::size_t col) const { 
+            return cells(row)[col].getString(); 
+        }
+
+        Row operator[] (RowID r) const { 
+            return Row(&cells(r), r, !isRemoved(r)); 
+        }
+
+        using iterator = Iterator;
+        iterator begin() const;
+        iterator end() const;
+
+        // The indices always describe the latest rows of the table, so 
+        // they only match the snapshot while the table is locked. Indices
+        // of shards are separate, so a concatenation has none.
+        bool hasIndex(std::size_t col) const { 
+            return m_parts.size() == 1 && m_parts[0].table->hasIndex(col); 
+        }
+
+        template<typename T>
+        const Index<T>* index(std::size_t col) const { 
+            return m_parts[0].table->index<T>(col); 
+        }
+
+        // Whether every part holds the column as dictionary codes.
+        bool encoded(std::size_t col) const
+        {
+            for (const Part& part : m_parts) {
+                if (!part.store->encoded[col]) return false;
+            }
+            return !m_parts.empty();
+        }
+
+        // Statistics of the tables behind the snapshot, merged; they too
+        // describe the latest rows.
+        ColumnStats stats(std::size_t col) const
+        {
+            ColumnStats stats;
+            for (const Part& part : m_parts) {
+                stats.merge(part.table->stats(col));
+            }
+            return stats;
+        }
+    };
+
+
     class Iterator
     {
-        Table* m_table;
-        RowID  m_row;
+        const Snapshot* m_snapshot;
+        RowID           m_row;
     public:
-        Iterator(Table* table, RowID row) : m_table(table), m_row(row) {}
+        Iterator(const Snapshot* snapshot, RowID row) 
+            : m_snapshot(snapshot), m_row(row) {}
 
         Iterator(const Iterator&) = default;
         Iterator(Iterator&&)      = default;
@@ -200,24 +561,24 @@ public:
         Iterator& operator= (Iterator&&)      = default;
 
         bool operator== (const Iterator& rhs) const { 
-            return m_table == rhs.m_table && 
-                   m_row   == rhs.m_row; 
+            return m_snapshot == rhs.m_snapshot && 
+                   m_row      == rhs.m_row; 
         }
                 
         bool operator!= (const Iterator& rhs) const { 
-            return m_table != rhs.m_table || 
-                   m_row   != rhs.m_row; 
+            return m_snapshot != rhs.m_snapshot || 
+                   m_row      != rhs.m_row; 
         }
 
         Iterator& operator++ () 
         {
-            if (++m_row == m_table->m_rows.size()) {
+            if (++m_row == m_snapshot->size()) {
                 m_row = -1;
             }
             return *this;
         }
         
-        Row operator*  () { return Row(m_table, m_row); }
+        Row operator*  () const { return (*m_snapshot)[m_row]; }
     };
 
 
@@ -244,14 +605,159 @@ public:
 
             ConstIterator& operator++ () { return (++m_iter, *this); }
             const T& operator* () const  { return m_iter->first;     }
+
+            const std::set<RowID>& rows() const { return m_iter->second; }
         };
 
+        // Sorted copy of the keys for the set intersection kernels. Numeric
+        // keys arriving in order are appended as they come, anything else 
+        // marks the array stale and it is rebuilt on the next request.
+        mutable std::vector<T> m_keys;
+        mutable bool           m_keysStale = false;
+        mutable std::mutex     m_keysMutex;
+
+        // Every key of the map, and maybe some removed since. Joins ask it
+        // before probing the map, which most keys of a join miss.
+        BloomFilter            m_bloom;
+
+        void addKey(const T& val)
+        {
+            appendKey(val);
+            charge.add(keyNodeBytes(val));
+
+            if (m_bloom.size() < m_bloom.capacity()) 
+            {
+                m_bloom.insert(BloomFilter::hash(val));
+                return;
+            }
+            // Full: rebuilt twice as large, which also drops removed keys.
+            BloomFilter bloom(2 * m_map.size());
+            for (const auto& pair : m_map) {
+                bloom.insert(BloomFilter::hash(pair.first));
+            }
+            charge.add(bloom.bytes());
+            charge.sub(m_bloom.bytes());
+            m_bloom = std::move(bloom);
+        }
+
+        void appendKey(const T& val)
+        {
+            if (m_keysStale) {
+                return;
+            }
+            if (std::is_arithmetic<T>::value && 
+                (m_keys.empty() || m_keys.back() < val)) 
+            {
+                std::size_t capacity = m_keys.capacity();
+                m_keys.push_back(val);
+                charge.add((m_keys.capacity() - capacity) * sizeof(T));
+            }
+            else {
+                m_keysStale = true;
+            }
+        }
+
+        std::size_t keysBytes() const
+        {
+            std::size_t bytes = m_keys.capacity() * sizeof(T);
+            for (const T& key : m_keys) {
+                bytes += memory::heapBytes(key);
+            }
+            return bytes;
+        }
+
+        static std::size_t keyNodeBytes(const T& val) {
+            return memory::treeNodeBytes<typename Container::value_type>() +
+                   memory::heapBytes(val);
+        }
+
+        static constexpr std::size_t ROW_NODE_BYTES = 
+                                        memory::treeNodeBytes<RowID>();
+
     public:
-        Index() = default;
+        // At most what insert() adds for the value, not counting growth().
+        static std::size_t entryBytes(const T& val) {
+            return keyNodeBytes(val) + ROW_NODE_BYTES;
+        }
 
-        void insert(const T& val, RowID row) { m_map[val].insert(row); }
-        void remove(RowID row);
-        void clear() override { m_map.clear(); }
+        // The key array doubles when it is full, and so does the filter.
+        std::size_t growth() const 
+        {
+            std::size_t bytes = 0;
+            if (!m_keysStale && m_keys.size() == m_keys.capacity()) {
+                bytes += std::max<std::size_t>(m_keys.size(), 1) * sizeof(T);
+            }
+            if (m_bloom.size() == m_bloom.capacity()) {
+                bytes += 2 * m_bloom.bytes();
+            }
+            return bytes;
+        }
+
+        explicit Index(std::shared_ptr<memory::Counter> memory = nullptr)
+            : AbstractIndex(std::move(memory)) 
+        {
+            charge.add(m_bloom.bytes());
+        }
+
+        void insert(const T& val, RowID row) 
+        { 
+            std::set<RowID>& rows = m_map[val];
+            if (rows.empty()) addKey(val);
+            if (rows.insert(row).second) charge.add(ROW_NODE_BYTES);
+        }
+
+        // Amortized constant time for keys arriving in order, as when an
+        // index is built from sorted rows.
+        void appendSorted(const T& val, RowID row)
+        {
+            if (!m_map.empty() && val < m_map.rbegin()->first) 
+            {
+                insert(val, row);
+                return;
+            }
+
+            auto last = m_map.empty() ? m_map.end() : std::prev(m_map.end());
+            if (last == m_map.end() || last->first < val) 
+            {
+                last = m_map.emplace_hint(m_map.end(), val, std::set<RowID>());
+                addKey(val);
+            }
+            std::size_t count = last->second.size();
+            last->second.emplace_hint(last->second.end(), row);
+            if (last->second.size() > count) charge.add(ROW_NODE_BYTES);
+        }
+
+        void remove(const T& val, RowID row)
+        {
+            auto found = m_map.find(val);
+            if (found == m_map.end()) {
+                return;
+            }
+            if (found->second.erase(row)) charge.sub(ROW_NODE_BYTES);
+            if (found->second.empty()) 
+            {
+                charge.sub(keyNodeBytes(found->first));
+                m_map.erase(found);
+                m_keysStale = true;
+            }
+        }
+
+        const std::vector<T>& keys() const
+        {
+            std::lock_guard<std::mutex> lock(m_keysMutex);
+            if (m_keysStale) 
+            {
+                charge.sub(keysBytes());
+                m_keys.clear();
+                m_keys.reserve(m_map.size());
+                for (const auto& pair : m_map) {
+                    m_keys.push_back(pair.first);
+                }
+                charge.add(keysBytes());
+                m_keysStale = false;
+            }
+            return m_keys;
+        }
 
         std::vector<RowID> rows(const T& val) const
         {
@@ -271,7 +777,71 @@ public:
         const_iterator find(const T& val) const {
             return ConstIterator(m_map.find(val));
         }
+
+        std::size_t keyCount() const { return m_map.size(); }
+
+        // False means the key is certainly not in the index.
+        bool mayContain(const T& val) const {
+            return m_bloom.mayContain(BloomFilter::hash(val));
+        }
     };
 };
 
+// Strings of the encoded columns of every table, each kept once under a
+// code. Equal strings have equal codes in all tables, so joins compare 
+// codes. An entry counts the cells pointing at it; sweep() drops those 
+// no cell holds any more and hands their codes to later strings.
+class Table::Dictionary
+{
+    using Entry = Cell::Interned;
+
+    mutable std::shared_mutex                                    m_mutex;
+    std::unordered_map<std::string_view, std::unique_ptr<Entry>> m_map;
+    std::vector<Code>                                            m_free;
+    memory::Charge                                               m_charge;
+
+public:
+    explicit Dictionary(std::shared_ptr<memory::Counter> memory = nullptr)
+        : m_charge(std::move(memory)) {}
+
+    Dictionary(const Dictionary&) = delete;
+    Dictionary& operator= (const Dictionary&) = delete;
+
+    // The entry of the string, added if it is new, with a reference for
+    // the cell that is to hold it.
+    const Entry* intern(const std::string& value);
+
+    // nullptr if the string is not there. Takes no reference, so the 
+    // entry may go with the last cell holding it; keep only its code.
+    const Entry* find(const std::string& value) const;
+
+    // Drops the entries no cell points at any more, and their charge;
+    // their codes are given to new strings. Returns how many went.
+    std::size_t sweep();
+
+    // Bytes intern() would add for the string.
+    std::size_t footprint(const std::string& value) const {
+        return find(value) ? 0 : entryBytes(value);
+    }
+
+    std::size_t size() const;
+    std::size_t bytes() const { return m_charge.bytes(); }
+
+private:
+    static std::size_t entryBytes(const std::string& value)
+    {
+        return sizeof(Entry) + memory::heapBytes(value) + 2 * sizeof(void*) + 
+               sizeof(std::pair<std::string_view, std::unique_ptr<Entry>>);
+    }
+};
+
+
+inline Table::Snapshot::iterator Table::Snapshot::begin() const { 
+    return m_size ? Iterator(this, 0) : end(); 
+}
+
+inline Table::Snapshot::iterator Table::Snapshot::end() const { 
+    return Iterator(this, -1); 
+}
+
 #endif // TABLE_H
\ No newline at end of file
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(std::size_t threads) : m_stop(false)
+{
+    for (std::size_t i = 1; i < threads; ++i) {
+        m_workers.emplace_back([this]() { work(); });
+    }
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+
+    for (std::thread& worker : m_workers) {
+        worker.join();
+    }
+}
+
+
+void ThreadPool::post(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+    }
+    m_cond.notify_one();
+}
+
+
+void ThreadPool::work()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+            if (m_tasks.empty()) {
+                return;
+            }
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        task();
+    }
+}
+
+
+void ThreadPool::parallelFor(std::size_t count, 
+                             const std::function<void(std::size_t)>& task)
+{
+    // Helpers may start after all the work is done (the workers can be 
+    // busy with other queries), so the state they touch is shared.
+    struct State
+    {
+        std::atomic<std::size_t> next{0};
+        std::size_t              remaining;
+        std::exception_ptr       error;
+        std::mutex               mutex;
+        std::condition_variable  done;
+    };
+
+    auto state = std::make_shared<State>();
+    state->remaining = count;
+
+    auto run = [state, &task, count]() 
+    {
+        std::size_t i;
+        while ((i = state->next++) < count) 
+        {
+            std::exception_ptr error;
+            try {
+                task(i);
+            }
+            catch (...) {
+                error = std::current_exception();
+            }
+
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (error && !state->error) {
+                state->error = error;
+            }
+            if (--state->remaining == 0) {
+                state->done.notify_all();
+            }
+        }
+    };
+
+    std::size_t helpers = std::min(count, size()) - (count ? 1 : 0);
+    for (std::size_t i = 0; i < helpers; ++i) {
+        post(run);
+    }
+    run();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->done.wait(lock, [&state]() { return state->remaining == 0; });
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
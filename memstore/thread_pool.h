@@ -0,0 +1,41 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads. The thread that calls parallelFor() takes
+// part in the work, so a pool of size 1 has no workers and runs inline.
+class ThreadPool
+{
+    std::vector<std::thread>          m_workers;
+    std::deque<std::function<void()>> m_tasks;
+    std::mutex                        m_mutex;
+    std::condition_variable           m_cond;
+    bool                              m_stop;
+
+public:
+    explicit ThreadPool(std::size_t threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator= (const ThreadPool&) = delete;
+
+    std::size_t size() const noexcept { return m_workers.size() + 1; }
+
+    void post(std::function<void()> task);
+
+    // Calls task(i) for every i in [0, count) and waits for all of them.
+    // The first exception thrown by a task is rethrown here.
+    void parallelFor(std::size_t count, 
+                     const std::function<void(std::size_t)>& task);
+
+private:
+    void work();
+};
+
+#endif // THREAD_POOL_H
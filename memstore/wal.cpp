@@ -0,0 +1,444 @@
+#include <cerrno>
+#include <cstring>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "codec.h"
+#include "mapped_file.h"
+#include "wal.h"
+
+using namespace codec;
+
+namespace
+{
+const std::size_t HEADER_SIZE = 8;
+const std::size_t MIN_ENTRY_SIZE = 9;   // lsn and op
+
+
+std::string begin(wal::Op op, const std::string& table)
+{
+    std::string out;
+    putU8(out, std::uint8_t(op));
+    putString(out, table);
+    return out;
+}
+
+
+wal::Entry decode(Reader& reader)
+{
+    wal::Entry entry;
+    entry.lsn = reader.u64();
+    entry.op = wal::Op(reader.u8());
+    entry.table = reader.string();
+
+    switch (entry.op)
+    {
+    case wal::Op::CREATE_TABLE:
+        entry.schema = reader.schema();
+        break;
+
+    case wal::Op::CREATE_INDEX:
+        entry.column = reader.string();
+        break;
+
+    case wal::Op::INSERT:
+        for (std::uint32_t n = reader.u32(); n > 0; --n) {
+            entry.values.push_back(reader.value());
+        }
+        break;
+
+    case wal::Op::REMOVE:
+        entry.column = reader.string();
+        entry.values.push_back(reader.value());
+        break;
+
+    case wal::Op::TRUNCATE:
+        break;
+
+    case wal::Op::LOAD:
+        entry.column = reader.string();
+        break;
+
+    default:
+        throw sql::Exception("write-ahead log: unknown entry");
+    }
+    return entry;
+}
+
+
+// Calls visit(pos, body, size) for every intact entry from the start of
+// the data until it returns false. Returns where the intact entries end.
+template<typename Visit>
+std::size_t scan(const char* data, std::size_t size, Visit visit)
+{
+    std::size_t pos = 0;
+    while (size - pos >= HEADER_SIZE)
+    {
+        Reader header(data + pos, HEADER_SIZE);
+        std::uint32_t length = header.u32();
+        std::uint32_t crc = header.u32();
+
+        const char* body = data + pos + HEADER_SIZE;
+        if (length < MIN_ENTRY_SIZE ||
+            size - pos - HEADER_SIZE < length ||
+            crc32(body, length) != crc)
+        {
+            break;
+        }
+        if (!visit(pos, body, length)) {
+            break;
+        }
+        pos += HEADER_SIZE + length;
+    }
+    return pos;
+}
+
+
+std::string writeAll(int fd, std::string_view data)
+{
+    const char* p = data.data();
+    std::size_t left = data.size();
+    while (left > 0)
+    {
+        ssize_t n = ::write(fd, p, left);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            return std::strerror(errno);
+        }
+        p += n;
+        left -= n;
+    }
+    if (::fdatasync(fd) != 0) {
+        return std::strerror(errno);
+    }
+    return std::string();
+}
+
+} // namespace
+
+
+std::string wal::encodeCreateTable(const std::string& table,
+                                   const Schema& schema)
+{
+    std::string out = begin(Op::CREATE_TABLE, table);
+    putSchema(out, schema);
+    return out;
+}
+
+
+std::string wal::encodeCreateIndex(const std::string& table,
+                                   const std::string& column)
+{
+    std::string out = begin(Op::CREATE_INDEX, table);
+    putString(out, column);
+    return out;
+}
+
+
+std::string wal::encodeInsert(const std::string& table, const Record& row)
+{
+    std::string out = begin(Op::INSERT, table);
+    putU32(out, row.size());
+    for (const DataObject& value : row) {
+        putValue(out, value);
+    }
+    return out;
+}
+
+
+std::string wal::encodeRemove(const std::string& table,
+                              const std::string& column,
+                              const DataObject& value)
+{
+    std::string out = begin(Op::REMOVE, table);
+    putString(out, column);
+    putValue(out, value);
+    return out;
+}
+
+
+std::string wal::encodeTruncate(const std::string& table)
+{
+    return begin(Op::TRUNCATE, table);
+}
+
+
+std::string wal::encodeLoad(const std::string& table, const std::string& path)
+{
+    std::string out = begin(Op::LOAD, table);
+    putString(out, path);
+    return out;
+}
+
+
+wal::Log::Log(const std::string& path, mem::Durability durability,
+              std::chrono::milliseconds interval, std::uint64_t lastLsn)
+    : m_path(path),
+      m_fd(::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                  0644)),
+      m_durability(durability),
+      m_interval(interval),
+      m_lastLsn(lastLsn),
+      m_syncedLsn(lastLsn),
+      m_trimLsn(0),
+      m_trimming(false),
+      m_stop(false)
+{
+    if (m_fd < 0) {
+        throw sql::Exception(fmt::sprintf("cannot open write-ahead log %v: %v",
+                                          path, std::strerror(errno)));
+    }
+    try {
+        syncDirectoryOf(path);
+    }
+    catch (...) 
+    {
+        ::close(m_fd);
+        throw;
+    }
+    m_flusher = std::thread([this]() { flush(); });
+}
+
+
+wal::Log::~Log()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_pending.notify_all();
+    m_flusher.join();
+    ::close(m_fd);
+}
+
+
+void wal::Log::check()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_error.empty()) {
+        throw sql::Exception("write-ahead log: " + m_error);
+    }
+}
+
+
+std::uint64_t wal::Log::append(const std::string& payload)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::uint64_t lsn = ++m_lastLsn;
+
+    std::size_t start = m_buffer.size();
+    m_buffer.append(HEADER_SIZE, '\0');
+    putU64(m_buffer, lsn);
+    m_buffer.append(payload);
+
+    std::string header;
+    std::size_t size = m_buffer.size() - start - HEADER_SIZE;
+    putU32(header, size);
+    putU32(header, crc32(m_buffer.data() + start + HEADER_SIZE, size));
+    m_buffer.replace(start, HEADER_SIZE, header);
+
+    if (m_durability != mem::Durability::INTERVAL) {
+        m_pending.notify_one();
+    }
+    return lsn;
+}
+
+
+void wal::Log::commit(std::uint64_t lsn)
+{
+    if (m_durability != mem::Durability::SYNC) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_synced.wait(lock, [this, lsn]() {
+        return m_syncedLsn >= lsn || !m_error.empty();
+    });
+    if (m_syncedLsn < lsn) {
+        throw sql::Exception("write-ahead log: " + m_error);
+    }
+}
+
+
+std::uint64_t wal::Log::lastLsn()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_lastLsn;
+}
+
+
+void wal::Log::trim(std::uint64_t lsn)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_trimming = true;
+    m_trimLsn = lsn;
+    m_pending.notify_one();
+    m_synced.wait(lock, [this]() { return !m_trimming; });
+
+    if (!m_trimError.empty()) {
+        throw sql::Exception("cannot trim write-ahead log: " + m_trimError);
+    }
+}
+
+
+std::string wal::Log::cut(std::uint64_t lsn)
+{
+    std::string temp = m_path + ".tmp";
+    try 
+    {
+        MappedFile file(m_path);
+        std::size_t end = scan(file.data(), file.size(), 
+            [lsn](std::size_t, const char* body, std::uint32_t length) {
+                return Reader(body, length).u64() <= lsn;
+            });
+        if (end == 0) {
+            return std::string();
+        }
+
+        int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                        0644);
+        if (fd < 0) {
+            return std::strerror(errno);
+        }
+        std::string error = writeAll(fd, std::string_view(file.data() + end, 
+                                                          file.size() - end));
+        ::close(fd);
+        if (error.empty() && ::rename(temp.c_str(), m_path.c_str()) != 0) {
+            error = std::strerror(errno);
+        }
+        if (!error.empty()) 
+        {
+            ::unlink(temp.c_str());
+            return error;
+        }
+    }
+    catch (sql::Exception& e) {
+        return e.what();
+    }
+
+    // Further groups go to the new file, once it is surely the log.
+    std::string error;
+    int fd = ::open(m_path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+    if (fd < 0) {
+        error = std::strerror(errno);
+    }
+    else 
+    {
+        try {
+            syncDirectoryOf(m_path);
+        }
+        catch (sql::Exception& e) 
+        {
+            error = e.what();
+            ::close(fd);
+        }
+    }
+    if (!error.empty())
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_error = error;
+        return error;
+    }
+    ::close(m_fd);
+    m_fd = fd;
+    return std::string();
+}
+
+
+void wal::Log::flush()
+{
+    std::string group;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        if (m_durability == mem::Durability::INTERVAL) {
+            m_pending.wait_for(lock, m_interval, [this]() { 
+                return m_stop || m_trimming; 
+            });
+        }
+        else {
+            m_pending.wait(lock, [this]() {
+                return m_stop || m_trimming || !m_buffer.empty();
+            });
+        }
+
+        // Between two groups, so nothing is written while the file is
+        // rewritten; appends go on into the buffer.
+        if (m_trimming)
+        {
+            std::uint64_t lsn = m_trimLsn;
+            lock.unlock();
+            std::string error = cut(lsn);
+            lock.lock();
+
+            m_trimError = error;
+            m_trimming = false;
+            m_synced.notify_all();
+        }
+
+        if (m_buffer.empty())
+        {
+            if (m_stop) return;
+            continue;
+        }
+
+        // Everything appended while the previous group was written goes
+        // out with a single fsync.
+        group.swap(m_buffer);
+        std::uint64_t lsn = m_lastLsn;
+
+        // After a failed write the file ends at the last good group: 
+        // later entries are dropped rather than written past a gap.
+        std::string error = m_error;
+        lock.unlock();
+        if (error.empty()) error = writeAll(m_fd, group);
+        group.clear();
+        lock.lock();
+
+        if (error.empty()) {
+            m_syncedLsn = lsn;
+        }
+        else {
+            m_error = error;
+        }
+        m_synced.notify_all();
+    }
+}
+
+
+std::uint64_t wal::Log::replay(const std::string& path,
+                               const std::function<void(Entry&&)>& apply)
+{
+    struct stat info;
+    if (::stat(path.c_str(), &info) != 0) {
+        return 0;
+    }
+
+    std::uint64_t lastLsn = 0;
+    std::size_t pos, size;
+    {
+        MappedFile file(path);
+        size = file.size();
+        pos = scan(file.data(), size, 
+            [&](std::size_t, const char* body, std::uint32_t length) 
+            {
+                Reader reader(body, length);
+                Entry entry = decode(reader);
+                lastLsn = entry.lsn;
+                apply(std::move(entry));
+                return true;
+            });
+    }
+
+    // The tail of a write interrupted by a crash.
+    if (pos < size && ::truncate(path.c_str(), pos) != 0) {
+        throw sql::Exception(fmt::sprintf("cannot repair write-ahead log %v: %v",
+                                          path, std::strerror(errno)));
+    }
+    return lastLsn;
+}
@@ -0,0 +1,132 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "memstore.h"
+#include "table.h"
+
+// Write-ahead log of the changes made to a Memstore. Every entry is
+//
+//   u32 size | u32 crc32 | u64 lsn | u8 op | payload
+//
+// where size and crc32 cover everything after them. Integers are little
+// endian, strings are a u32 length and the bytes, values a type tag and
+// the value. An entry torn by a crash fails the check and ends the replay.
+namespace wal
+{
+enum class Op : std::uint8_t
+{
+    CREATE_TABLE = 1,
+    CREATE_INDEX = 2,
+    INSERT       = 3,
+    REMOVE       = 4,
+    TRUNCATE     = 5,
+    LOAD         = 6,
+};
+
+
+// A decoded entry; only the fields of its op are set.
+struct Entry
+{
+    std::uint64_t  lsn = 0;
+    Op             op;
+    std::string    table;
+    std::string    column;    // CREATE_INDEX, REMOVE; the file of LOAD
+    Schema         schema;    // CREATE_TABLE
+    Record         values;    // the row of INSERT, the value of REMOVE
+};
+
+
+// Payloads of the entries, built before the change they describe.
+std::string encodeCreateTable(const std::string& table, const Schema& schema);
+std::string encodeCreateIndex(const std::string& table,
+                              const std::string& column);
+std::string encodeInsert(const std::string& table, const Record& row);
+std::string encodeRemove(const std::string& table, const std::string& column,
+                         const DataObject& value);
+std::string encodeTruncate(const std::string& table);
+
+// A bulk load is logged by the name of its file, which must still be 
+// there when the log is replayed.
+std::string encodeLoad(const std::string& table, const std::string& path);
+
+
+// Appends are collected in memory and written by one flusher thread, so
+// writers that arrive during an fsync share the next one (group commit).
+class Log
+{
+    const std::string         m_path;
+    int                       m_fd;
+    mem::Durability           m_durability;
+    std::chrono::milliseconds m_interval;
+
+    std::mutex                m_mutex;
+    std::condition_variable   m_pending;
+    std::condition_variable   m_synced;
+    std::string               m_buffer;
+    std::uint64_t             m_lastLsn;
+    std::uint64_t             m_syncedLsn;
+    std::string               m_error;
+    std::uint64_t             m_trimLsn;
+    bool                      m_trimming;
+    std::string               m_trimError;
+    bool                      m_stop;
+    std::thread               m_flusher;
+
+public:
+    // Appends to the file at path; LSNs continue after lastLsn.
+    Log(const std::string& path, mem::Durability durability,
+        std::chrono::milliseconds interval, std::uint64_t lastLsn);
+
+    // Writes and syncs whatever is still pending.
+    ~Log();
+
+    Log(const Log&) = delete;
+    Log& operator= (const Log&) = delete;
+
+    // Throws if an earlier write of the log failed. Called before a 
+    // change is applied, so a log that cannot be written refuses changes
+    // instead of missing them.
+    void check();
+
+    // Adds an entry to the next group and returns its LSN. Called under
+    // the lock of the changed table, so the log has the order of changes.
+    // The change is already applied, so it does not throw; once a write
+    // has failed nothing more is written and commit() reports the error.
+    std::uint64_t append(const std::string& payload);
+
+    // Returns once the entry is as durable as the mode promises: on disk
+    // for SYNC, at once for the others. Throws if the log cannot be written.
+    void commit(std::uint64_t lsn);
+
+    // The LSN of the latest entry appended.
+    std::uint64_t lastLsn();
+
+    // Drops the entries up to lsn, which a snapshot holds, by rewriting
+    // the file without them. Appends go on meanwhile; throws if the file
+    // cannot be rewritten, leaving it as it was.
+    void trim(std::uint64_t lsn);
+
+    // Calls apply for every intact entry of the file in order, reading
+    // it through a mapping, and cuts off a torn tail. Returns the last
+    // LSN, 0 for a missing or empty log.
+    static std::uint64_t replay(const std::string& path,
+                                const std::function<void(Entry&&)>& apply);
+
+private:
+    void flush();
+
+    // Does the work of trim() on the flusher thread; returns the error.
+    std::string cut(std::uint64_t lsn);
+};
+
+} // namespace wal
+
+#endif // WAL_H
@@ -2,7 +2,9 @@
 #define PROTOCOL_H
 
 #include <iostream>
+#include <memory_resource>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
 
@@ -13,13 +15,30 @@ namespace proto
 const std::string SHOW         = "SHOW";
 const std::string INSERT       = "INSERT";
 const std::string TRUNCATE     = "TRUNCATE";
+const std::string DELETE       = "DELETE";
+const std::string SNAPSHOT     = "SNAPSHOT";
+const std::string LOAD         = "LOAD";
+const std::string MEMORY       = "MEMORY";
+const std::string EXPLAIN      = "EXPLAIN";
 const std::string INTERSECTION = "INTERSECTION";
 const std::string SYMDIFF      = "SYMMETRIC_DIFFERENCE";
 
 
+// What a handler keeps for a connection from one request to the next.
+class IConnectionState
+{
+public:
+    virtual ~IConnectionState() = default;
+};
+
+
+// The query points into the connection's buffer. What the handler takes
+// from `memory` is released at once when the request is done.
 struct Request
 {
-    std::string query;
+    std::string_view           query;
+    std::pmr::memory_resource *memory = std::pmr::get_default_resource();
+    IConnectionState          *state = nullptr;
 };
 
 
@@ -27,7 +46,7 @@ class IResponseWriter
 {
 public:
     virtual void writeError(const std::string& message) = 0;
-    virtual void write(const std::string& data)         = 0;
+    virtual void write(std::string_view data)           = 0;
     virtual ~IResponseWriter() = default;
 };
 
@@ -35,6 +54,13 @@ public:
 class IHandler
 {
 public:
+    // Called when a connection opens; its requests, which come one at a
+    // time, all carry the state returned and the same `memory`.
+    virtual std::unique_ptr<IConnectionState> open(
+                                    std::pmr::memory_resource* /*memory*/) {
+        return nullptr;
+    }
+
     virtual void handle(IResponseWriter* rw, Request& req) = 0;
     virtual ~IHandler() = default;
 };
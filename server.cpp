@@ -1,4 +1,4 @@
-#include <sstream>
+#include <cstddef>
 #include <thread>
 #include "protocol.h"
 
@@ -10,18 +10,30 @@ class Session : public std::enable_shared_from_this<Session>,
 
     proto::IHandler *m_handler;
 
-    std::ostringstream m_response;
-    std::string        m_responseStatus;
+    // Requests allocate from the arena, which starts in the session's own
+    // buffer and is released as a whole after each of them.
+    static const std::size_t ARENA_BYTES = 16 * 1024;
+    alignas(std::max_align_t) char      m_arenaBuffer[ARENA_BYTES];
+    std::pmr::monotonic_buffer_resource m_arena;
+
+    std::unique_ptr<proto::IConnectionState> m_state;
+
+    // Kept from one response to the next, with its capacity.
+    std::string m_response;
+    std::string m_responseStatus;
 
 public:
     Session(boost::asio::ip::tcp::socket sock, proto::IHandler* handler) 
-        : m_socket(std::move(sock)), m_handler(handler) {}
+        : m_socket(std::move(sock)), m_handler(handler),
+          m_arena(m_arenaBuffer, ARENA_BYTES) {}
 
     ~Session() {
         m_socket.close();
     }
 
-    void start() {
+    void start() 
+    {
+        m_state = m_handler->open(&m_arena);
         recv();
     }
 
@@ -29,8 +41,8 @@ public:
         m_responseStatus = "ERR " + message;
     }
 
-    void write(const std::string& data) override {
-        m_response << data;
+    void write(std::string_view data) override {
+        m_response.append(data);
     }
 
 private:
@@ -41,28 +53,30 @@ private:
             [this, self](const boost::system::error_code& err, std::size_t n)
             {
                 if (!err) {
-                    m_response.str("");
+                    m_response.clear();
                     m_responseStatus = "OK";
                     
-                    proto::Request req{std::string(m_buf, n)};
+                    proto::Request req{std::string_view(m_buf, n), &m_arena,
+                                       m_state.get()};
                     m_handler->handle(this, req);
+                    m_arena.release();
 
-                    if (!m_response.str().empty() && 
-                        m_response.str().back() != '\n') 
-                    {
-                        m_response << '\n';
+                    if (!m_response.empty() && m_response.back() != '\n') {
+                        m_response += '\n';
                     }
-                    m_response << m_responseStatus << std::endl;
+                    m_response += m_responseStatus;
+                    m_response += '\n';
 
-                    send(m_response.str());
+                    send();
                 }
         });
     }
 
-    void send(std::string&& s)
+    // The response stays untouched until the write is done.
+    void send()
     {   
         auto self(shared_from_this());
-        boost::asio::async_write(m_socket, boost::asio::buffer(s),
+        boost::asio::async_write(m_socket, boost::asio::buffer(m_response),
             [this, self](boost::system::error_code err, std::size_t /*length*/)
             {
                 if (!err) {